@@ -0,0 +1,275 @@
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+
+#include <rosbag/bag.h>
+#include <rosbag/view.h>
+#include <message_filters/simple_filter.h>
+#include <message_filters/synchronizer.h>
+#include <message_filters/sync_policies/exact_time.h>
+#include <message_filters/sync_policies/approximate_time.h>
+#include <boost/foreach.hpp>
+#include <boost/bind.hpp>
+
+#include "offline_odometer.hpp"
+
+namespace
+{
+
+/**
+ * Passes messages read from a bag on to a message filter, so that they
+ * are synchronized the same way the odometer nodes synchronize their
+ * subscriptions.
+ */
+template<class M>
+class BagSubscriber : public message_filters::SimpleFilter<M>
+{
+public:
+  void newMessage(const boost::shared_ptr<M const>& msg)
+  {
+    this->signalMessage(msg);
+  }
+};
+
+typedef message_filters::sync_policies::ExactTime<sensor_msgs::Image,
+        sensor_msgs::Image, sensor_msgs::CameraInfo, sensor_msgs::CameraInfo> ExactPolicy;
+typedef message_filters::sync_policies::ApproximateTime<sensor_msgs::Image,
+        sensor_msgs::Image, sensor_msgs::CameraInfo, sensor_msgs::CameraInfo> ApproximatePolicy;
+typedef message_filters::Synchronizer<ExactPolicy> ExactSync;
+typedef message_filters::Synchronizer<ApproximatePolicy> ApproximateSync;
+
+/**
+ * Runs the odometer on the synchronized tuples (left and right or image
+ * and depth, then their camera infos) and writes poses and statistics.
+ */
+class BagOdometer
+{
+public:
+
+  BagOdometer(const fovis::VisualOdometryOptions& options, bool stereo,
+      std::ostream& pose_file, std::ostream* stats_file) :
+    odometer_(options),
+    stereo_(stereo),
+    pose_file_(pose_file),
+    stats_file_(stats_file),
+    num_frames(0),
+    num_failures(0),
+    processing_time(0.0)
+  {
+  }
+
+  void process(const sensor_msgs::ImageConstPtr& image0,
+      const sensor_msgs::ImageConstPtr& image1,
+      const sensor_msgs::CameraInfoConstPtr& info0,
+      const sensor_msgs::CameraInfoConstPtr& info1)
+  {
+    const ros::Time& stamp = image0->header.stamp;
+    bool ok = stereo_ ?
+      odometer_.processStereo(image0, image1, info0, info1) :
+      odometer_.processMonoDepth(image0, image1, info0, info1);
+    if (!ok)
+    {
+      ROS_WARN("Could not process frame at %f.", stamp.toSec());
+      return;
+    }
+
+    const fovis_ros::FovisInfo& info = odometer_.getInfo();
+    ++num_frames;
+    if (!info.motion_estimate_valid) ++num_failures;
+    processing_time += info.runtime;
+
+    const Eigen::Isometry3d& pose = odometer_.getPose();
+    Eigen::Quaterniond rotation(pose.rotation());
+    pose_file_ << stamp.toSec() << " "
+               << pose.translation().x() << " "
+               << pose.translation().y() << " "
+               << pose.translation().z() << " "
+               << rotation.x() << " " << rotation.y() << " "
+               << rotation.z() << " " << rotation.w() << std::endl;
+    if (stats_file_)
+    {
+      *stats_file_ << stamp.toSec() << " "
+                   << info.motion_estimate_status_code << " "
+                   << info.num_total_keypoints << " "
+                   << info.num_matches << " "
+                   << info.num_inliers << " "
+                   << info.conversion_time << " "
+                   << info.depth_update_time << " "
+                   << info.process_frame_time << " "
+                   << info.runtime << std::endl;
+    }
+  }
+
+private:
+
+  fovis_ros::OfflineOdometer odometer_;
+  bool stereo_;
+  std::ostream& pose_file_;
+  std::ostream* stats_file_;
+
+public:
+
+  int num_frames;
+  int num_failures;
+  double processing_time;
+};
+
+void printUsage()
+{
+  std::cerr << "Usage: fovis_bag_odometer <stereo|mono_depth> <bag file> <pose file> [name:=value...]\n"
+            << "Runs fovis on all synchronized input tuples of the bag as fast as possible\n"
+            << "and writes the camera poses in TUM format (stamp tx ty tz qx qy qz qw).\n"
+            << "Arguments:\n"
+            << "\tstats:=<file>   also write per frame statistics\n"
+            << "\tstereo:=<ns>    stereo namespace (stereo mode, default /stereo)\n"
+            << "\timage:=<name>   image topic name (stereo mode, default image_rect)\n"
+            << "\tcamera:=<ns>    camera namespace (mono_depth mode, default /camera)\n"
+            << "\tapproximate_sync:=<true|false>  pair messages with approximately\n"
+            << "\t                equal stamps (default as the node: false for stereo,\n"
+            << "\t                true for mono_depth)\n"
+            << "\tqueue_size:=<n> synchronizer queue size (default 5)\n"
+            << "\t<option>:=<value> any fovis option, e.g. fast_threshold:=20"
+            << std::endl;
+}
+
+} // end of anonymous namespace
+
+int main(int argc, char **argv)
+{
+  if (argc < 4)
+  {
+    printUsage();
+    return 1;
+  }
+  ros::Time::init();
+
+  std::string mode = argv[1];
+  if (mode != "stereo" && mode != "mono_depth")
+  {
+    printUsage();
+    return 1;
+  }
+
+  // parse name:=value arguments
+  std::map<std::string, std::string> args;
+  args["stereo"] = "/stereo";
+  args["image"] = "image_rect";
+  args["camera"] = "/camera";
+  args["stats"] = "";
+  args["approximate_sync"] = mode == "stereo" ? "false" : "true";
+  args["queue_size"] = "5";
+  fovis::VisualOdometryOptions options =
+    fovis::VisualOdometry::getDefaultOptions();
+  if (!fovis_ros::OfflineOdometer::parseArguments(argc, argv, 4, args, options))
+  {
+    printUsage();
+    return 1;
+  }
+
+  // input topics, images first, then camera infos
+  std::vector<std::string> topics;
+  if (mode == "stereo")
+  {
+    topics.push_back(ros::names::clean(args["stereo"] + "/left/" + args["image"]));
+    topics.push_back(ros::names::clean(args["stereo"] + "/right/" + args["image"]));
+    topics.push_back(ros::names::clean(args["stereo"] + "/left/camera_info"));
+    topics.push_back(ros::names::clean(args["stereo"] + "/right/camera_info"));
+  }
+  else
+  {
+    topics.push_back(ros::names::clean(args["camera"] + "/rgb/image_rect"));
+    topics.push_back(ros::names::clean(args["camera"] + "/depth_registered/image_rect"));
+    topics.push_back(ros::names::clean(args["camera"] + "/rgb/camera_info"));
+    topics.push_back(ros::names::clean(args["camera"] + "/depth_registered/camera_info"));
+  }
+
+  rosbag::Bag bag;
+  try
+  {
+    bag.open(argv[2], rosbag::bagmode::Read);
+  }
+  catch (const rosbag::BagException& e)
+  {
+    std::cerr << "Could not open bag: " << e.what() << std::endl;
+    return 1;
+  }
+
+  std::ofstream pose_file(argv[3]);
+  if (!pose_file)
+  {
+    std::cerr << "Could not open " << argv[3] << std::endl;
+    return 1;
+  }
+  pose_file << std::fixed << std::setprecision(9);
+  pose_file << "# timestamp tx ty tz qx qy qz qw" << std::endl;
+  std::ofstream stats_file;
+  if (!args["stats"].empty())
+  {
+    stats_file.open(args["stats"].c_str());
+    if (!stats_file)
+    {
+      std::cerr << "Could not open " << args["stats"] << std::endl;
+      return 1;
+    }
+    stats_file << std::fixed << std::setprecision(9);
+    stats_file << "# timestamp status num_keypoints num_matches num_inliers "
+                  "conversion_time depth_update_time process_frame_time runtime"
+               << std::endl;
+  }
+
+  // the synchronizer only keeps queue_size messages per topic, so
+  // unmatched messages do not pile up
+  BagOdometer odometer(options, mode == "stereo", pose_file,
+      stats_file.is_open() ? &stats_file : NULL);
+  BagSubscriber<sensor_msgs::Image> image_subs[2];
+  BagSubscriber<sensor_msgs::CameraInfo> info_subs[2];
+  const int queue_size = std::max(1, atoi(args["queue_size"].c_str()));
+  boost::shared_ptr<ExactSync> exact_sync;
+  boost::shared_ptr<ApproximateSync> approximate_sync;
+  if (args["approximate_sync"] == "true" || args["approximate_sync"] == "True")
+  {
+    approximate_sync.reset(new ApproximateSync(ApproximatePolicy(queue_size),
+          image_subs[0], image_subs[1], info_subs[0], info_subs[1]));
+    approximate_sync->registerCallback(
+        boost::bind(&BagOdometer::process, &odometer, _1, _2, _3, _4));
+  }
+  else
+  {
+    exact_sync.reset(new ExactSync(ExactPolicy(queue_size),
+          image_subs[0], image_subs[1], info_subs[0], info_subs[1]));
+    exact_sync->registerCallback(
+        boost::bind(&BagOdometer::process, &odometer, _1, _2, _3, _4));
+  }
+  ros::WallTime start_time = ros::WallTime::now();
+
+  rosbag::View view(bag, rosbag::TopicQuery(topics));
+  BOOST_FOREACH(const rosbag::MessageInstance& m, view)
+  {
+    int index = std::find(topics.begin(), topics.end(), m.getTopic()) - topics.begin();
+    if (index < 2)
+    {
+      sensor_msgs::ImageConstPtr image = m.instantiate<sensor_msgs::Image>();
+      if (image) image_subs[index].newMessage(image);
+    }
+    else
+    {
+      sensor_msgs::CameraInfoConstPtr info = m.instantiate<sensor_msgs::CameraInfo>();
+      if (info) info_subs[index - 2].newMessage(info);
+    }
+  }
+  bag.close();
+
+  double total_time = (ros::WallTime::now() - start_time).toSec();
+  ROS_INFO("Processed %d frames (%d without valid motion estimate) in %.2fs "
+           "(%.1f fps, %.1f fps without reading the bag).",
+           odometer.num_frames, odometer.num_failures, total_time,
+           total_time > 0.0 ? odometer.num_frames / total_time : 0.0,
+           odometer.processing_time > 0.0 ?
+             odometer.num_frames / odometer.processing_time : 0.0);
+  return 0;
+}
+
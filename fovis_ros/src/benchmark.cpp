@@ -0,0 +1,446 @@
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+
+#include <ros/ros.h>
+#include <geometry_msgs/PoseStamped.h>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/scoped_ptr.hpp>
+
+#include "odometer_base.hpp"
+#include "stereo_odometer.hpp"
+#include "mono_depth_odometer.hpp"
+#include "work_stealing_pool.hpp"
+#include "offline_odometer.hpp"
+#include "dataset_reader.hpp"
+#include "evaluation.hpp"
+#include "synthetic_scene.hpp"
+
+namespace
+{
+
+using fovis_ros::SyntheticScene;
+
+/**
+ * Renders the frames of the scripted trajectory of a synthetic scene
+ * one by one, as stereo pairs or as images with depth.
+ */
+class SyntheticSceneReader : public fovis_ros::DatasetReader
+{
+
+public:
+
+  SyntheticSceneReader(SyntheticScene::Type type,
+      const SyntheticScene::Camera& camera, double baseline, double rate,
+      bool stereo) :
+    scene_(type), camera_(camera), baseline_(baseline), rate_(rate),
+    stereo_(stereo), index_(0)
+  {
+  }
+
+  bool read(fovis_ros::DatasetFrame& frame)
+  {
+    double t = index_++ / rate_;
+    Eigen::Isometry3d pose = SyntheticScene::trajectory(t);
+
+    // new messages for every frame, as the odometers may keep them
+    frame.stereo = stereo_;
+    frame.images[0] = createImage(camera_.width, camera_.height,
+        sensor_msgs::image_encodings::MONO8, 1);
+    frame.infos[0] = createCameraInfo(camera_.width, camera_.height,
+        camera_.fx, camera_.fy, camera_.cx, camera_.cy, 0.0);
+    if (stereo_)
+    {
+      frame.images[1] = createImage(camera_.width, camera_.height,
+          sensor_msgs::image_encodings::MONO8, 1);
+      frame.infos[1] = createCameraInfo(camera_.width, camera_.height,
+          camera_.fx, camera_.fy, camera_.cx, camera_.cy, baseline_);
+      Eigen::Isometry3d right_pose = pose *
+        Eigen::Translation3d(baseline_, 0.0, 0.0);
+      scene_.render(pose, camera_, frame.images[0]->data.data(), NULL);
+      scene_.render(right_pose, camera_, frame.images[1]->data.data(), NULL);
+    }
+    else
+    {
+      frame.images[1] = createImage(camera_.width, camera_.height,
+          sensor_msgs::image_encodings::TYPE_32FC1, sizeof(float));
+      frame.infos[1] = frame.infos[0];
+      scene_.render(pose, camera_, frame.images[0]->data.data(),
+          reinterpret_cast<float*>(frame.images[1]->data.data()));
+    }
+    setHeader(frame, ros::Time(1.0 + t), "camera");
+    frame.has_ground_truth = true;
+    frame.ground_truth = pose;
+    return true;
+  }
+
+private:
+
+  SyntheticScene scene_;
+  SyntheticScene::Camera camera_;
+  double baseline_;
+  double rate_;
+  bool stereo_;
+  int index_;
+};
+
+/**
+ * Minimal odometer that is fed with the frames of a DatasetReader
+ * instead of subscriptions, so that frames take the same path through
+ * OdometerBase::process() as in the nodes: conversion, optional
+ * rectification, the sequential, pipelined or pool mode and publishing.
+ * Depth sources and input conversions are those of StereoOdometer and
+ * MonoDepthOdometer.
+ */
+class BenchmarkOdometer : public fovis_ros::OdometerBase
+{
+
+public:
+
+  BenchmarkOdometer(const ros::NodeHandle& local_nh, bool rectify,
+      fovis_ros::WorkStealingPool* pool) :
+    OdometerBase(local_nh, boost::shared_ptr<tf::TransformListener>(), pool),
+    rectify_(rectify),
+    stereo_depth_(NULL),
+    stereo_calibration_(NULL),
+    depth_image_(NULL)
+  {
+  }
+
+  ~BenchmarkOdometer()
+  {
+    stopPipeline();
+    if (stereo_depth_) delete stereo_depth_;
+    if (stereo_calibration_) delete stereo_calibration_;
+    if (depth_image_) delete depth_image_;
+  }
+
+  void feed(const fovis_ros::DatasetFrame& input)
+  {
+    if (!stereo_depth_ && !depth_image_)
+    {
+      if (input.stereo)
+      {
+        stereo_depth_ = fovis_ros::StereoOdometer::createStereoDepth(
+            input.infos[0], input.infos[1], getOptions(), stereo_calibration_);
+        setDepthSource(stereo_depth_);
+      }
+      else
+      {
+        depth_image_ = fovis_ros::MonoDepthOdometer::createDepthSource(
+            input.infos[0], input.infos[1]);
+        setDepthSource(depth_image_);
+      }
+      if (rectify_)
+      {
+        createRectificationTable(*input.infos[0], rectification_table_);
+        createRectificationTable(*input.infos[1], r_rectification_table_);
+        setRectificationTable(&rectification_table_);
+      }
+    }
+
+    // in pool mode inputs are dropped while all frames are busy, the
+    // benchmark waits instead
+    BenchmarkFrame* frame = static_cast<BenchmarkFrame*>(acquireFrame(true));
+    if (!frame) return;
+
+    frame->image1_msg = input.images[1];
+    if (input.stereo)
+    {
+      frame->r_image_data = grayImageData(*input.images[1],
+          frame->r_image_buffer, frame->r_cv_image);
+      if (rectify_)
+      {
+        frame->r_rectified_buffer.resize(
+            r_rectification_table_.width * r_rectification_table_.height);
+        fovis_ros::image_conversion::remap(frame->r_image_data,
+            r_rectification_table_, frame->r_rectified_buffer.data());
+        frame->r_image_data = frame->r_rectified_buffer.data();
+      }
+    }
+    else
+    {
+      frame->depth_data = fovis_ros::MonoDepthOdometer::metricDepthData(
+          *input.images[1], frame->depth_buffer);
+    }
+    process(frame, input.images[0], input.infos[0]);
+  }
+
+protected:
+
+  Frame* createFrame() const
+  {
+    return new BenchmarkFrame();
+  }
+
+  void updateDepthSource(const Frame& frame)
+  {
+    const BenchmarkFrame& benchmark_frame =
+      static_cast<const BenchmarkFrame&>(frame);
+    if (stereo_depth_) stereo_depth_->setRightImage(benchmark_frame.r_image_data);
+    else depth_image_->setDepthImage(benchmark_frame.depth_data);
+  }
+
+private:
+
+  struct BenchmarkFrame : public Frame
+  {
+    // right or depth image, kept alive while the frame is in use
+    sensor_msgs::ImageConstPtr image1_msg;
+    cv_bridge::CvImageConstPtr r_cv_image;
+    const uint8_t* r_image_data;
+    fovis_ros::image_conversion::AlignedBuffer r_image_buffer;
+    std::vector<uint8_t> r_rectified_buffer;
+    const float* depth_data;
+    std::vector<float> depth_buffer;
+  };
+
+  bool rectify_;
+  fovis::StereoDepth* stereo_depth_;
+  fovis::StereoCalibration* stereo_calibration_;
+  fovis::DepthImage* depth_image_;
+  fovis_ros::image_conversion::RemapTable rectification_table_;
+  fovis_ros::image_conversion::RemapTable r_rectification_table_;
+};
+
+/**
+ * Receives the ~info and ~pose messages a BenchmarkOdometer publishes,
+ * within the process, and adds them to an Evaluation in frame order.
+ */
+class ResultCollector
+{
+
+public:
+
+  ResultCollector(ros::NodeHandle& local_nh, int num_frames)
+  {
+    // queues large enough that no message is dropped
+    info_sub_ = local_nh.subscribe("info", num_frames + 10,
+        &ResultCollector::infoCallback, this);
+    pose_sub_ = local_nh.subscribe("pose", num_frames + 10,
+        &ResultCollector::poseCallback, this);
+  }
+
+  void addGroundTruth(const ros::Time& stamp, const Eigen::Isometry3d& pose)
+  {
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    ground_truth_[stamp] = pose;
+  }
+
+  /**
+   * Waits until an info message has been received for every frame with
+   * ground truth.
+   * \return false on timeout
+   */
+  bool wait(double timeout)
+  {
+    ros::WallTime end = ros::WallTime::now() + ros::WallDuration(timeout);
+    while (ros::WallTime::now() < end)
+    {
+      {
+        boost::lock_guard<boost::mutex> lock(mutex_);
+        if (infos_.size() >= ground_truth_.size()) return true;
+      }
+      ros::WallDuration(0.01).sleep();
+    }
+    return false;
+  }
+
+  /**
+   * Adds all received frames to evaluation. Frames without pose, i.e.
+   * without valid motion estimate, keep the previous pose as the
+   * odometer does.
+   */
+  void evaluate(fovis_ros::Evaluation& evaluation)
+  {
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    Eigen::Isometry3d pose = Eigen::Isometry3d::Identity();
+    for (std::map<ros::Time, fovis_ros::FovisInfo>::const_iterator it =
+          infos_.begin(); it != infos_.end(); ++it)
+    {
+      PoseMap::const_iterator estimated = poses_.find(it->first);
+      if (estimated != poses_.end()) pose = estimated->second;
+      PoseMap::const_iterator truth = ground_truth_.find(it->first);
+      evaluation.add(it->second, pose,
+          truth != ground_truth_.end() ? &truth->second : NULL);
+    }
+  }
+
+private:
+
+  typedef std::map<ros::Time, Eigen::Isometry3d, std::less<ros::Time>,
+          Eigen::aligned_allocator<std::pair<const ros::Time, Eigen::Isometry3d> > > PoseMap;
+
+  void infoCallback(const fovis_ros::FovisInfoConstPtr& info_msg)
+  {
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    infos_[info_msg->header.stamp] = *info_msg;
+  }
+
+  void poseCallback(const geometry_msgs::PoseStampedConstPtr& pose_msg)
+  {
+    const geometry_msgs::Pose& p = pose_msg->pose;
+    Eigen::Isometry3d pose = Eigen::Isometry3d::Identity();
+    pose.translation() = Eigen::Vector3d(p.position.x, p.position.y, p.position.z);
+    pose.linear() = Eigen::Quaterniond(p.orientation.w, p.orientation.x,
+        p.orientation.y, p.orientation.z).toRotationMatrix();
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    poses_[pose_msg->header.stamp] = pose;
+  }
+
+  boost::mutex mutex_;
+  std::map<ros::Time, fovis_ros::FovisInfo> infos_;
+  PoseMap poses_;
+  PoseMap ground_truth_;
+  ros::Subscriber info_sub_;
+  ros::Subscriber pose_sub_;
+};
+
+/**
+ * Runs frames of reader through a BenchmarkOdometer with the parameters
+ * in args and prints the evaluation.
+ */
+void runNode(const std::string& name, fovis_ros::DatasetReader& reader,
+    int num_frames, std::map<std::string, std::string>& args,
+    const fovis::VisualOdometryOptions& options)
+{
+  ros::NodeHandle local_nh("~" + name);
+  for (fovis::VisualOdometryOptions::const_iterator it = options.begin();
+      it != options.end(); ++it)
+  {
+    std::string key = it->first;
+    std::replace(key.begin(), key.end(), '-', '_');
+    local_nh.setParam(key, it->second);
+  }
+  local_nh.setParam("pipelined", args["pipelined"] == "true");
+  // the rendered camera is the robot, so no tf is needed
+  local_nh.setParam("base_link_frame_id", std::string("camera"));
+
+  int num_threads = atoi(args["pool"].c_str());
+  boost::scoped_ptr<fovis_ros::WorkStealingPool> pool(
+      num_threads > 0 ? new fovis_ros::WorkStealingPool(num_threads) : NULL);
+  ResultCollector collector(local_nh, num_frames);
+  {
+    BenchmarkOdometer odometer(local_nh, args["rectify"] == "true", pool.get());
+    fovis_ros::DatasetFrame frame;
+    for (int i = 0; i < num_frames && reader.read(frame); ++i)
+    {
+      collector.addGroundTruth(frame.images[0]->header.stamp, frame.ground_truth);
+      odometer.feed(frame);
+    }
+    if (!collector.wait(10.0))
+    {
+      ROS_WARN("Not all results of %s have been received.", name.c_str());
+    }
+  }
+  ros::param::del(local_nh.getNamespace());
+
+  fovis_ros::Evaluation evaluation;
+  collector.evaluate(evaluation);
+  evaluation.print(name);
+}
+
+void printUsage()
+{
+  std::cerr << "Usage: fovis_benchmark [name:=value...]\n"
+            << "Runs the odometers on procedurally rendered scenes with known motion.\n"
+            << "Arguments:\n"
+            << "\tmode:=<stereo|mono_depth|all>  odometers to run (default all)\n"
+            << "\tscene:=<planar|boxy>  scene to render (default boxy)\n"
+            << "\tframes:=<n>           number of frames (default 300)\n"
+            << "\trate:=<hz>            frame rate of the trajectory (default 30)\n"
+            << "\twidth:=<px> height:=<px>  image size (default 640x480)\n"
+            << "\tbaseline:=<m>         stereo baseline (default 0.1)\n"
+            << "\tpath:=<node|offline|auto>  node feeds the frames through\n"
+            << "\t                      OdometerBase::process() and needs a ROS master,\n"
+            << "\t                      offline uses OfflineOdometer, auto (default) is\n"
+            << "\t                      node if a master is running\n"
+            << "\tpipelined:=<true|false>  pipelined mode (node, default false)\n"
+            << "\tpool:=<threads>       process frames in a thread pool (node, default 0)\n"
+            << "\trectify:=<true|false> rectify in the node (node, default false)\n"
+            << "\t<option>:=<value>     any fovis option, e.g. fast_threshold:=20"
+            << std::endl;
+}
+
+} // end of anonymous namespace
+
+int main(int argc, char **argv)
+{
+  ros::Time::init();
+
+  std::map<std::string, std::string> args;
+  args["mode"] = "all";
+  args["scene"] = "boxy";
+  args["frames"] = "300";
+  args["rate"] = "30";
+  args["width"] = "640";
+  args["height"] = "480";
+  args["baseline"] = "0.1";
+  args["path"] = "auto";
+  args["pipelined"] = "false";
+  args["pool"] = "0";
+  args["rectify"] = "false";
+  fovis::VisualOdometryOptions options =
+    fovis::VisualOdometry::getDefaultOptions();
+  if (!fovis_ros::OfflineOdometer::parseArguments(argc, argv, 1, args, options) ||
+      (args["scene"] != "planar" && args["scene"] != "boxy"))
+  {
+    printUsage();
+    return 1;
+  }
+
+  // name:=value arguments are ours, so they are not passed as remappings
+  ros::init(ros::M_string(), "fovis_benchmark",
+      ros::init_options::AnonymousName | ros::init_options::NoSigintHandler);
+  bool node = args["path"] == "node" ||
+    (args["path"] == "auto" && ros::master::check());
+  if (args["path"] == "node" && !ros::master::check())
+  {
+    std::cerr << "path:=node needs a running ROS master" << std::endl;
+    return 1;
+  }
+  boost::scoped_ptr<ros::AsyncSpinner> spinner;
+  if (node)
+  {
+    spinner.reset(new ros::AsyncSpinner(1));
+    spinner->start();
+  }
+
+  SyntheticScene::Type scene = args["scene"] == "planar" ?
+    SyntheticScene::PLANAR : SyntheticScene::BOXY;
+  int frames = atoi(args["frames"].c_str());
+  double rate = atof(args["rate"].c_str());
+  double baseline = atof(args["baseline"].c_str());
+  SyntheticScene::Camera camera;
+  camera.width = atoi(args["width"].c_str());
+  camera.height = atoi(args["height"].c_str());
+  camera.fx = camera.fy = 0.8 * camera.width;
+  camera.cx = (camera.width - 1) / 2.0;
+  camera.cy = (camera.height - 1) / 2.0;
+
+  printf("Scene '%s', %dx%d pixels, %d frames at %.1f Hz, %s kernels, %s\n",
+      args["scene"].c_str(), camera.width, camera.height, frames, rate,
+      fovis_ros::image_conversion::instructionSet(),
+      node ? "OdometerBase::process()" : "OfflineOdometer");
+  // rendering happens outside of the measured stages
+  for (int stereo = 1; stereo >= 0; --stereo)
+  {
+    std::string name = stereo ? "stereo" : "mono_depth";
+    if (args["mode"] != "all" && args["mode"] != name) continue;
+    SyntheticSceneReader reader(scene, camera, baseline, rate, stereo);
+    if (node)
+    {
+      runNode(name, reader, frames, args, options);
+      continue;
+    }
+    fovis_ros::OfflineOdometer odometer(options);
+    fovis_ros::Evaluation evaluation;
+    evaluation.run(reader, odometer, frames);
+    evaluation.print(name);
+  }
+  return 0;
+}
+
@@ -0,0 +1,109 @@
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+
+#include <boost/scoped_ptr.hpp>
+
+#include "offline_odometer.hpp"
+#include "dataset_reader.hpp"
+#include "evaluation.hpp"
+
+namespace
+{
+
+void printUsage()
+{
+  std::cerr << "Usage: fovis_dataset_odometer <tum|kitti> <sequence directory> [name:=value...]\n"
+            << "Runs fovis on a sequence of the TUM RGB-D (mono depth) or KITTI odometry\n"
+            << "(stereo) benchmark and reports throughput, latency and trajectory errors.\n"
+            << "Arguments:\n"
+            << "\tgroundtruth:=<file>   ground truth trajectory (tum: relative to the\n"
+            << "\t                      sequence, default groundtruth.txt; kitti: poses file)\n"
+            << "\tassociations:=<file>  associations file (tum, default associations.txt)\n"
+            << "\tfx:= fy:= cx:= cy:=   intrinsics (tum, default 525 525 319.5 239.5)\n"
+            << "\tdepth_scale:=<value>  depth image value of one metre (tum, default 5000)\n"
+            << "\tframes:=<n>           number of frames to process, 0 for all (default 0)\n"
+            << "\ttrajectory:=<file>    write the camera poses in TUM format\n"
+            << "\thistogram_bin:=<ms>   bin width of the latency histogram (default 5)\n"
+            << "\t<option>:=<value>     any fovis option, e.g. fast_threshold:=20"
+            << std::endl;
+}
+
+} // end of anonymous namespace
+
+int main(int argc, char **argv)
+{
+  if (argc < 3)
+  {
+    printUsage();
+    return 1;
+  }
+  ros::Time::init();
+
+  std::string type = argv[1];
+  std::string directory = argv[2];
+  if (type != "tum" && type != "kitti")
+  {
+    printUsage();
+    return 1;
+  }
+
+  std::map<std::string, std::string> args;
+  args["groundtruth"] = type == "tum" ? "groundtruth.txt" : "";
+  args["associations"] = "associations.txt";
+  args["fx"] = "525.0";
+  args["fy"] = "525.0";
+  args["cx"] = "319.5";
+  args["cy"] = "239.5";
+  args["depth_scale"] = "5000.0";
+  args["frames"] = "0";
+  args["trajectory"] = "";
+  args["histogram_bin"] = "5.0";
+  fovis::VisualOdometryOptions options =
+    fovis::VisualOdometry::getDefaultOptions();
+  if (!fovis_ros::OfflineOdometer::parseArguments(argc, argv, 3, args, options))
+  {
+    printUsage();
+    return 1;
+  }
+
+  boost::scoped_ptr<fovis_ros::DatasetReader> reader;
+  if (type == "tum")
+  {
+    reader.reset(new fovis_ros::TumRgbdReader(directory,
+          args["associations"], args["groundtruth"],
+          atof(args["fx"].c_str()), atof(args["fy"].c_str()),
+          atof(args["cx"].c_str()), atof(args["cy"].c_str()),
+          atof(args["depth_scale"].c_str())));
+  }
+  else
+  {
+    reader.reset(new fovis_ros::KittiReader(directory, args["groundtruth"]));
+  }
+
+  std::ofstream trajectory_file;
+  if (!args["trajectory"].empty())
+  {
+    trajectory_file.open(args["trajectory"].c_str());
+    if (!trajectory_file)
+    {
+      std::cerr << "Could not open " << args["trajectory"] << std::endl;
+      return 1;
+    }
+    trajectory_file << "# timestamp tx ty tz qx qy qz qw" << std::endl;
+  }
+
+  fovis_ros::OfflineOdometer odometer(options);
+  fovis_ros::Evaluation evaluation(atof(args["histogram_bin"].c_str()) / 1000.0);
+  int num_frames = evaluation.run(*reader, odometer, atoi(args["frames"].c_str()),
+      trajectory_file.is_open() ? &trajectory_file : NULL);
+  if (num_frames == 0)
+  {
+    std::cerr << "No frames processed." << std::endl;
+    return 1;
+  }
+  evaluation.print(type + " " + directory);
+  return 0;
+}
+
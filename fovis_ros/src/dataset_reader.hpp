@@ -0,0 +1,374 @@
+#ifndef DATASET_READER_H_
+#define DATASET_READER_H_
+
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <sstream>
+#include <string>
+
+#include <ros/ros.h>
+#include <sensor_msgs/Image.h>
+#include <sensor_msgs/CameraInfo.h>
+#include <sensor_msgs/image_encodings.h>
+#include <cv_bridge/cv_bridge.h>
+#include <opencv2/highgui/highgui.hpp>
+
+#include <Eigen/Geometry>
+
+namespace fovis_ros
+{
+
+/**
+ * Input of one frame as the odometer nodes would receive it, either a
+ * stereo pair or an image with registered depth image (32FC1, metres).
+ */
+struct DatasetFrame
+{
+  bool stereo;
+  // left and right or image and depth
+  sensor_msgs::ImagePtr images[2];
+  sensor_msgs::CameraInfoPtr infos[2];
+
+  bool has_ground_truth;
+  // camera to world, in the optical frame of the (left) camera
+  Eigen::Isometry3d ground_truth;
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+/**
+ * Base class for readers that provide the frames of a data set one by
+ * one.
+ */
+class DatasetReader
+{
+
+public:
+
+  virtual ~DatasetReader() {}
+
+  /**
+   * Reads the next frame.
+   * \return false at the end of the data set or on errors
+   */
+  virtual bool read(DatasetFrame& frame) = 0;
+
+  /**
+   * Creates the camera info of a rectified camera, the same way a
+   * calibrated camera driver would publish it.
+   * \param baseline distance to the left camera of a stereo pair, 0 for
+   *        the left camera or a mono camera
+   */
+  static sensor_msgs::CameraInfoPtr createCameraInfo(int width, int height,
+      double fx, double fy, double cx, double cy, double baseline)
+  {
+    sensor_msgs::CameraInfoPtr info(new sensor_msgs::CameraInfo());
+    info->width = width;
+    info->height = height;
+    info->distortion_model = "plumb_bob";
+    info->D.assign(5, 0.0);
+    info->K[0] = fx; info->K[2] = cx;
+    info->K[4] = fy; info->K[5] = cy;
+    info->K[8] = 1.0;
+    info->R[0] = info->R[4] = info->R[8] = 1.0;
+    info->P[0] = fx; info->P[2] = cx;
+    info->P[3] = -fx * baseline;
+    info->P[5] = fy; info->P[6] = cy;
+    info->P[10] = 1.0;
+    return info;
+  }
+
+  static sensor_msgs::ImagePtr createImage(int width, int height,
+      const std::string& encoding, int pixel_size)
+  {
+    sensor_msgs::ImagePtr image(new sensor_msgs::Image());
+    image->width = width;
+    image->height = height;
+    image->encoding = encoding;
+    image->step = width * pixel_size;
+    image->data.resize(image->step * height);
+    return image;
+  }
+
+protected:
+
+  static void setHeader(DatasetFrame& frame, const ros::Time& stamp,
+      const std::string& frame_id)
+  {
+    for (int i = 0; i < 2; ++i)
+    {
+      frame.images[i]->header.stamp = stamp;
+      frame.images[i]->header.frame_id = frame_id;
+      frame.infos[i]->header = frame.images[i]->header;
+    }
+  }
+
+  static sensor_msgs::ImagePtr loadGrayImage(const std::string& filename)
+  {
+    cv::Mat image = cv::imread(filename, CV_LOAD_IMAGE_GRAYSCALE);
+    if (image.empty())
+    {
+      return sensor_msgs::ImagePtr();
+    }
+    cv_bridge::CvImage cv_image;
+    cv_image.encoding = sensor_msgs::image_encodings::MONO8;
+    cv_image.image = image;
+    return cv_image.toImageMsg();
+  }
+};
+
+/**
+ * Reads a sequence of the TUM RGB-D benchmark: color and depth images
+ * as listed in an associations file (as written by associate.py) and
+ * the ground truth trajectory. The TUM depth images are converted to
+ * metres, intrinsics have to be given as they are not part of the
+ * sequence.
+ */
+class TumRgbdReader : public DatasetReader
+{
+
+public:
+
+  /**
+   * \param directory sequence directory
+   * \param associations associations file, relative to directory
+   * \param ground_truth ground truth file relative to directory, empty
+   *        if not available
+   * \param depth_scale depth image value of one metre
+   */
+  TumRgbdReader(const std::string& directory, const std::string& associations,
+      const std::string& ground_truth, double fx, double fy, double cx, double cy,
+      double depth_scale) :
+    directory_(directory),
+    fx_(fx), fy_(fy), cx_(cx), cy_(cy),
+    depth_scale_(depth_scale)
+  {
+    associations_.open((directory_ + "/" + associations).c_str());
+    if (!associations_)
+    {
+      ROS_ERROR("Could not open associations file '%s'.",
+          (directory_ + "/" + associations).c_str());
+    }
+    if (!ground_truth.empty())
+    {
+      loadGroundTruth(directory_ + "/" + ground_truth);
+    }
+  }
+
+  bool read(DatasetFrame& frame)
+  {
+    std::string line;
+    while (std::getline(associations_, line))
+    {
+      if (line.empty() || line[0] == '#') continue;
+      std::istringstream stream(line);
+      double stamp, depth_stamp;
+      std::string image_file, depth_file;
+      if (!(stream >> stamp >> image_file >> depth_stamp >> depth_file))
+        continue;
+
+      frame.stereo = false;
+      frame.images[0] = loadGrayImage(directory_ + "/" + image_file);
+      cv::Mat depth = cv::imread(directory_ + "/" + depth_file,
+          CV_LOAD_IMAGE_ANYDEPTH);
+      if (!frame.images[0] || depth.empty() || depth.type() != CV_16UC1)
+      {
+        ROS_ERROR("Could not load '%s' or '%s'.",
+            image_file.c_str(), depth_file.c_str());
+        return false;
+      }
+      frame.images[1] = createImage(depth.cols, depth.rows,
+          sensor_msgs::image_encodings::TYPE_32FC1, sizeof(float));
+      float* depth_data = reinterpret_cast<float*>(frame.images[1]->data.data());
+      for (int v = 0; v < depth.rows; ++v)
+      {
+        const uint16_t* row = depth.ptr<uint16_t>(v);
+        for (int u = 0; u < depth.cols; ++u)
+        {
+          *depth_data++ = row[u] == 0 ?
+            std::numeric_limits<float>::quiet_NaN() : row[u] / depth_scale_;
+        }
+      }
+      frame.infos[0] = createCameraInfo(frame.images[0]->width,
+          frame.images[0]->height, fx_, fy_, cx_, cy_, 0.0);
+      frame.infos[1] = frame.infos[0];
+      setHeader(frame, ros::Time(stamp), "openni_rgb_optical_frame");
+      frame.has_ground_truth = lookupGroundTruth(stamp, frame.ground_truth);
+      return true;
+    }
+    return false;
+  }
+
+private:
+
+  void loadGroundTruth(const std::string& filename)
+  {
+    std::ifstream file(filename.c_str());
+    if (!file)
+    {
+      ROS_WARN("Could not open ground truth file '%s'.", filename.c_str());
+      return;
+    }
+    std::string line;
+    while (std::getline(file, line))
+    {
+      if (line.empty() || line[0] == '#') continue;
+      std::istringstream stream(line);
+      double stamp, tx, ty, tz, qx, qy, qz, qw;
+      if (!(stream >> stamp >> tx >> ty >> tz >> qx >> qy >> qz >> qw))
+        continue;
+      Eigen::Isometry3d pose = Eigen::Isometry3d::Identity();
+      pose.translation() = Eigen::Vector3d(tx, ty, tz);
+      pose.linear() = Eigen::Quaterniond(qw, qx, qy, qz).toRotationMatrix();
+      ground_truth_.insert(std::make_pair(stamp, pose));
+    }
+  }
+
+  /**
+   * Looks for the ground truth pose closest in time, at most 20ms away.
+   */
+  bool lookupGroundTruth(double stamp, Eigen::Isometry3d& pose) const
+  {
+    static const double kMaxDifference = 0.02;
+    if (ground_truth_.empty()) return false;
+    PoseMap::const_iterator best = ground_truth_.lower_bound(stamp);
+    if (best != ground_truth_.begin())
+    {
+      PoseMap::const_iterator before = best;
+      --before;
+      if (best == ground_truth_.end() ||
+          stamp - before->first < best->first - stamp)
+        best = before;
+    }
+    if (best == ground_truth_.end()) return false;
+    if (std::fabs(best->first - stamp) > kMaxDifference) return false;
+    pose = best->second;
+    return true;
+  }
+
+  typedef std::map<double, Eigen::Isometry3d, std::less<double>,
+          Eigen::aligned_allocator<std::pair<const double, Eigen::Isometry3d> > > PoseMap;
+
+  std::string directory_;
+  std::ifstream associations_;
+  double fx_, fy_, cx_, cy_;
+  double depth_scale_;
+  PoseMap ground_truth_;
+};
+
+/**
+ * Reads a sequence of the KITTI odometry benchmark: rectified gray
+ * stereo pairs, calibration from calib.txt, time stamps from times.txt
+ * and optionally the ground truth poses.
+ */
+class KittiReader : public DatasetReader
+{
+
+public:
+
+  /**
+   * \param directory sequence directory, e.g. dataset/sequences/00
+   * \param ground_truth ground truth file, e.g. dataset/poses/00.txt,
+   *        empty if not available
+   */
+  KittiReader(const std::string& directory, const std::string& ground_truth) :
+    directory_(directory),
+    index_(0),
+    valid_(true)
+  {
+    valid_ = loadCalibration(directory_ + "/calib.txt");
+    times_.open((directory_ + "/times.txt").c_str());
+    if (!ground_truth.empty())
+    {
+      ground_truth_.open(ground_truth.c_str());
+      if (!ground_truth_)
+      {
+        ROS_WARN("Could not open ground truth file '%s'.", ground_truth.c_str());
+      }
+    }
+  }
+
+  bool read(DatasetFrame& frame)
+  {
+    if (!valid_) return false;
+    char name[16];
+    snprintf(name, sizeof(name), "%06d.png", index_);
+    frame.stereo = true;
+    frame.images[0] = loadGrayImage(directory_ + "/image_0/" + name);
+    frame.images[1] = loadGrayImage(directory_ + "/image_1/" + name);
+    if (!frame.images[0] || !frame.images[1]) return false;
+
+    frame.infos[0] = createCameraInfo(frame.images[0]->width,
+        frame.images[0]->height, fx_, fy_, cx_, cy_, 0.0);
+    frame.infos[1] = createCameraInfo(frame.images[1]->width,
+        frame.images[1]->height, fx_, fy_, cx_, cy_, baseline_);
+    double stamp;
+    if (!(times_ >> stamp)) stamp = index_ * 0.1;
+    setHeader(frame, ros::Time(stamp), "camera_left");
+
+    frame.has_ground_truth = false;
+    if (ground_truth_.is_open())
+    {
+      Eigen::Matrix<double, 3, 4> pose;
+      for (int i = 0; i < 12; ++i) ground_truth_ >> pose(i / 4, i % 4);
+      if (ground_truth_)
+      {
+        frame.ground_truth.matrix().topRows<3>() = pose;
+        frame.ground_truth.matrix().row(3) << 0.0, 0.0, 0.0, 1.0;
+        frame.has_ground_truth = true;
+      }
+    }
+    ++index_;
+    return true;
+  }
+
+private:
+
+  /**
+   * Reads the projection matrices P0 and P1 of the gray cameras.
+   */
+  bool loadCalibration(const std::string& filename)
+  {
+    std::ifstream file(filename.c_str());
+    std::string line;
+    double p0[12], p1[12];
+    bool have_p0 = false, have_p1 = false;
+    while (std::getline(file, line))
+    {
+      std::istringstream stream(line);
+      std::string key;
+      stream >> key;
+      double* p = key == "P0:" ? p0 : (key == "P1:" ? p1 : NULL);
+      if (!p) continue;
+      for (int i = 0; i < 12; ++i) stream >> p[i];
+      if (!stream) continue;
+      if (p == p0) have_p0 = true; else have_p1 = true;
+    }
+    if (!have_p0 || !have_p1)
+    {
+      ROS_ERROR("Could not read P0 and P1 from '%s'.", filename.c_str());
+      return false;
+    }
+    fx_ = p0[0];
+    fy_ = p0[5];
+    cx_ = p0[2];
+    cy_ = p0[6];
+    baseline_ = -p1[3] / p1[0];
+    return true;
+  }
+
+  std::string directory_;
+  std::ifstream times_;
+  std::ifstream ground_truth_;
+  int index_;
+  bool valid_;
+  double fx_, fy_, cx_, cy_;
+  double baseline_;
+};
+
+} // end of namespace
+
+#endif
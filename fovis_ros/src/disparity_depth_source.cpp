@@ -0,0 +1,115 @@
+#include <cmath>
+
+#include <libfovis/frame.hpp>
+#include <libfovis/feature_match.hpp>
+
+#include "disparity_depth_source.hpp"
+
+
+fovis_ros::DisparityDepthSource::DisparityDepthSource(
+    const fovis::CameraIntrinsicsParameters& parameters, double baseline) :
+  parameters_(parameters),
+  baseline_(baseline),
+  disparity_(NULL),
+  min_disparity_(0.0f)
+{
+}
+
+void fovis_ros::DisparityDepthSource::setDisparityImage(
+    const float* disparity, float min_disparity)
+{
+  disparity_ = disparity;
+  min_disparity_ = min_disparity;
+}
+
+bool fovis_ros::DisparityDepthSource::haveXyz(int u, int v)
+{
+  if (u < 0 || v < 0 || u >= parameters_.width || v >= parameters_.height)
+    return false;
+  return isValid(disparity_[v * parameters_.width + u]);
+}
+
+void fovis_ros::DisparityDepthSource::getXyz(fovis::OdometryFrame* frame)
+{
+  for (int level_num = 0; level_num < frame->getNumLevels(); ++level_num)
+  {
+    fovis::PyramidLevel* level = frame->getLevel(level_num);
+    for (int kp_ind = 0; kp_ind < level->getNumKeypoints(); ++kp_ind)
+    {
+      fovis::KeypointData* kp_data = level->getKeypointData(kp_ind);
+      int u = static_cast<int>(kp_data->rect_base_uv(0) + 0.5);
+      int v = static_cast<int>(kp_data->rect_base_uv(1) + 0.5);
+      if (haveXyz(u, v))
+      {
+        setXyz(u, v, disparity_[v * parameters_.width + u], kp_data);
+      }
+      else
+      {
+        kp_data->has_depth = false;
+        kp_data->disparity = NAN;
+        kp_data->xyz = Eigen::Vector3d(NAN, NAN, NAN);
+        kp_data->xyzw = Eigen::Vector4d(NAN, NAN, NAN, NAN);
+      }
+    }
+  }
+}
+
+void fovis_ros::DisparityDepthSource::refineXyz(fovis::FeatureMatch* matches,
+    int num_matches, fovis::OdometryFrame* frame)
+{
+  for (int m_ind = 0; m_ind < num_matches; ++m_ind)
+  {
+    fovis::FeatureMatch& match = matches[m_ind];
+    if (match.status != fovis::MATCH_NEEDS_DEPTH_REFINEMENT)
+      continue;
+    fovis::KeypointData* kp_data = &match.refined_target_keypoint;
+    float disparity;
+    if (interpolateDisparity(kp_data->rect_base_uv(0),
+          kp_data->rect_base_uv(1), disparity))
+    {
+      setXyz(kp_data->rect_base_uv(0), kp_data->rect_base_uv(1),
+          disparity, kp_data);
+      match.status = fovis::MATCH_OK;
+    }
+    else
+    {
+      match.status = fovis::MATCH_REFINEMENT_FAILED;
+      match.inlier = false;
+    }
+  }
+}
+
+bool fovis_ros::DisparityDepthSource::interpolateDisparity(
+    double u, double v, float& disparity) const
+{
+  int u0 = static_cast<int>(std::floor(u));
+  int v0 = static_cast<int>(std::floor(v));
+  if (u0 < 0 || v0 < 0 ||
+      u0 + 1 >= parameters_.width || v0 + 1 >= parameters_.height)
+    return false;
+  const float* row0 = disparity_ + v0 * parameters_.width + u0;
+  const float* row1 = row0 + parameters_.width;
+  // refuse to interpolate across depth discontinuities or holes
+  if (!isValid(row0[0]) || !isValid(row0[1]) ||
+      !isValid(row1[0]) || !isValid(row1[1]))
+    return false;
+  double wu = u - u0;
+  double wv = v - v0;
+  disparity = (1 - wv) * ((1 - wu) * row0[0] + wu * row0[1]) +
+                    wv * ((1 - wu) * row1[0] + wu * row1[1]);
+  return true;
+}
+
+void fovis_ros::DisparityDepthSource::setXyz(double u, double v,
+    float disparity, fovis::KeypointData* kp_data) const
+{
+  double z = parameters_.fx * baseline_ / disparity;
+  kp_data->has_depth = true;
+  kp_data->disparity = disparity;
+  kp_data->xyz = Eigen::Vector3d((u - parameters_.cx) * z / parameters_.fx,
+                                 (v - parameters_.cy) * z / parameters_.fy,
+                                 z);
+  kp_data->xyzw.head<3>() = kp_data->xyz;
+  kp_data->xyzw.w() = 1;
+}
+
@@ -0,0 +1,72 @@
+#ifndef DISPARITY_DEPTH_SOURCE_H_
+#define DISPARITY_DEPTH_SOURCE_H_
+
+#include <libfovis/depth_source.hpp>
+#include <libfovis/camera_intrinsics.hpp>
+
+namespace fovis_ros
+{
+
+/**
+ * Depth source that looks up the depth of keypoints in a dense
+ * disparity image, e.g. as computed by stereo_image_proc. Compared to
+ * fovis::StereoDepth this avoids matching each keypoint in the right
+ * image again.
+ */
+class DisparityDepthSource : public fovis::DepthSource
+{
+
+public:
+
+  /**
+   * \param parameters intrinsics of the rectified left camera,
+   *        the disparity image must have the same size
+   * \param baseline stereo baseline in metres
+   */
+  DisparityDepthSource(const fovis::CameraIntrinsicsParameters& parameters,
+      double baseline);
+
+  /**
+   * Sets the disparity image for the next frame. The data is not copied,
+   * it has to stay valid until the frame has been processed.
+   * \param disparity packed disparity image in pixels
+   * \param min_disparity smaller disparities are treated as invalid
+   */
+  void setDisparityImage(const float* disparity, float min_disparity);
+
+  virtual bool haveXyz(int u, int v);
+
+  virtual void getXyz(fovis::OdometryFrame* frame);
+
+  virtual void refineXyz(fovis::FeatureMatch* matches, int num_matches,
+      fovis::OdometryFrame* frame);
+
+  virtual double getBaseline() const
+  {
+    return baseline_;
+  }
+
+private:
+
+  bool isValid(float disparity) const
+  {
+    return disparity >= min_disparity_ && disparity > 0.0f;
+  }
+
+  // bilinear interpolation of the disparity at a sub-pixel position
+  bool interpolateDisparity(double u, double v, float& disparity) const;
+
+  void setXyz(double u, double v, float disparity,
+      fovis::KeypointData* kp_data) const;
+
+  fovis::CameraIntrinsicsParameters parameters_;
+  double baseline_;
+
+  const float* disparity_;
+  float min_disparity_;
+};
+
+} // end of namespace
+
+#endif
+
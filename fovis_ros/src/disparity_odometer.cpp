@@ -0,0 +1,19 @@
+#include "disparity_odometer.hpp"
+
+int main(int argc, char **argv)
+{
+  ros::init(argc, argv, "disparity_odometer");
+  if (ros::names::remap("stereo") == "stereo") {
+    ROS_WARN("'stereo' has not been remapped! Example command-line usage:\n"
+             "\t$ rosrun fovis_ros disparity_odometer stereo:=narrow_stereo image:=image_rect");
+  }
+
+  std::string transport = argc > 1 ? argv[1] : "raw";
+  ros::NodeHandle nh;
+  ros::NodeHandle local_nh("~");
+  fovis_ros::DisparityOdometer odometer(nh, local_nh, transport);
+
+  ros::spin();
+  return 0;
+}
+
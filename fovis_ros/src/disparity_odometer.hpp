@@ -0,0 +1,127 @@
+#ifndef DISPARITY_ODOMETER_H_
+#define DISPARITY_ODOMETER_H_
+
+#include <ros/ros.h>
+#include <sensor_msgs/image_encodings.h>
+#include <image_geometry/pinhole_camera_model.h>
+#include <cv_bridge/cv_bridge.h>
+
+#include <fovis_ros/FovisInfo.h>
+
+#include "disparity_processor.hpp"
+#include "disparity_depth_source.hpp"
+#include "odometer_base.hpp"
+#include "image_conversion.hpp"
+
+namespace fovis_ros
+{
+
+/**
+ * Stereo odometer that takes the depth of the keypoints from a dense
+ * disparity image instead of matching them in the right image.
+ */
+class DisparityOdometer : public DisparityProcessor, OdometerBase
+{
+
+private:
+
+  DisparityDepthSource* disparity_depth_;
+
+  struct DisparityFrame : public Frame
+  {
+    // keeps the disparity image alive if it is used without a copy
+    stereo_msgs::DisparityImageConstPtr disparity_msg;
+    const float* disparity_data;
+    // packed copy of the disparity image, only used for padded input
+    std::vector<float> disparity_buffer;
+  };
+
+public:
+
+  DisparityOdometer(const ros::NodeHandle& nh, const ros::NodeHandle& local_nh,
+      const std::string& transport) :
+    DisparityProcessor(nh, local_nh, transport),
+    OdometerBase(local_nh),
+    disparity_depth_(NULL)
+  {
+    subscribe();
+  }
+
+  ~DisparityOdometer()
+  {
+    unsubscribe();
+    stopPipeline();
+    if (disparity_depth_) delete disparity_depth_;
+  }
+
+protected:
+
+  DisparityDepthSource* createDepthSource(
+      const sensor_msgs::CameraInfoConstPtr& l_info_msg,
+      const stereo_msgs::DisparityImageConstPtr& disparity_msg) const
+  {
+    // read calibration info from camera info message
+    image_geometry::PinholeCameraModel model;
+    model.fromCameraInfo(*l_info_msg);
+
+    // initialize left camera parameters
+    fovis::CameraIntrinsicsParameters parameters;
+    rosToFovis(model, parameters);
+
+    // the baseline is given by the disparity image
+    return new DisparityDepthSource(parameters, disparity_msg->T);
+  }
+
+  void imageCallback(
+      const sensor_msgs::ImageConstPtr& l_image_msg,
+      const sensor_msgs::CameraInfoConstPtr& l_info_msg,
+      const stereo_msgs::DisparityImageConstPtr& disparity_msg)
+  {
+    const sensor_msgs::Image& disparity_image = disparity_msg->image;
+    if (disparity_image.encoding != sensor_msgs::image_encodings::TYPE_32FC1)
+    {
+      ROS_ERROR("Disparity image must be in 32bit floating point format!");
+      return;
+    }
+    ROS_ASSERT(disparity_image.width == l_image_msg->width);
+    ROS_ASSERT(disparity_image.height == l_image_msg->height);
+
+    if (!disparity_depth_)
+    {
+      disparity_depth_ = createDepthSource(l_info_msg, disparity_msg);
+      setDepthSource(disparity_depth_);
+    }
+
+    DisparityFrame* frame = static_cast<DisparityFrame*>(acquireFrame());
+    if (!frame) return;
+    frame->num_dropped_inputs = getNumDroppedInputs();
+
+    frame->disparity_msg = disparity_msg;
+    // libfovis needs packed rows, repack padded images
+    frame->disparity_data = image_conversion::packedData(
+        disparity_image.data.data(), disparity_image.step,
+        disparity_image.width, disparity_image.height,
+        frame->disparity_buffer);
+
+    // call base implementation
+    process(frame, l_image_msg, l_info_msg);
+  }
+
+  Frame* createFrame() const
+  {
+    return new DisparityFrame();
+  }
+
+  void updateDepthSource(const Frame& frame)
+  {
+    const DisparityFrame& disparity_frame =
+      static_cast<const DisparityFrame&>(frame);
+    // pass disparities to depth source
+    disparity_depth_->setDisparityImage(disparity_frame.disparity_data,
+        disparity_frame.disparity_msg->min_disparity);
+  }
+};
+
+} // end of namespace
+
+#endif
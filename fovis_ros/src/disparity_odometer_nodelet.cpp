@@ -0,0 +1,34 @@
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
+#include <boost/scoped_ptr.hpp>
+
+#include "disparity_odometer.hpp"
+
+namespace fovis_ros
+{
+
+/**
+ * Nodelet version of the disparity odometer. Running it in the same
+ * manager as stereo_image_proc avoids serialization and copies of
+ * the incoming images.
+ */
+class DisparityOdometerNodelet : public nodelet::Nodelet
+{
+
+private:
+
+  boost::scoped_ptr<DisparityOdometer> odometer_;
+
+  virtual void onInit()
+  {
+    std::string transport;
+    getPrivateNodeHandle().param("transport", transport, std::string("raw"));
+    odometer_.reset(new DisparityOdometer(
+          getNodeHandle(), getPrivateNodeHandle(), transport));
+  }
+};
+
+} // end of namespace
+
+PLUGINLIB_EXPORT_CLASS(fovis_ros::DisparityOdometerNodelet, nodelet::Nodelet)
+
@@ -0,0 +1,204 @@
+#ifndef DISPARITY_PROCESSOR_H_
+#define DISPARITY_PROCESSOR_H_
+
+#include <ros/ros.h>
+#include <sensor_msgs/Image.h>
+#include <sensor_msgs/CameraInfo.h>
+#include <stereo_msgs/DisparityImage.h>
+
+#include <message_filters/subscriber.h>
+#include <message_filters/synchronizer.h>
+#include <message_filters/sync_policies/exact_time.h>
+#include <message_filters/sync_policies/approximate_time.h>
+#include <image_transport/subscriber_filter.h>
+
+#include "input_age_filter.hpp"
+
+namespace fovis_ros
+{
+
+/**
+ * This is an abstract base class for nodes that process a left stereo
+ * image together with a precomputed disparity image, such as the one
+ * published by stereo_image_proc.
+ * It handles synchronization of input topics (approximate or exact)
+ * and checks for sync errors.
+ * To use this class, subclass it and implement the imageCallback() method.
+ */
+class DisparityProcessor
+{
+
+private:
+
+  ros::NodeHandle nh_;
+  ros::NodeHandle local_nh_;
+  std::string transport_;
+
+  // subscriber
+  image_transport::SubscriberFilter left_sub_;
+  message_filters::Subscriber<sensor_msgs::CameraInfo> left_info_sub_;
+  message_filters::Subscriber<stereo_msgs::DisparityImage> disparity_sub_;
+  typedef message_filters::sync_policies::ExactTime<sensor_msgs::Image, sensor_msgs::CameraInfo, stereo_msgs::DisparityImage> ExactPolicy;
+  typedef message_filters::sync_policies::ApproximateTime<sensor_msgs::Image, sensor_msgs::CameraInfo, stereo_msgs::DisparityImage> ApproximatePolicy;
+  typedef message_filters::Synchronizer<ExactPolicy> ExactSync;
+  typedef message_filters::Synchronizer<ApproximatePolicy> ApproximateSync;
+  boost::shared_ptr<ExactSync> exact_sync_;
+  boost::shared_ptr<ApproximateSync> approximate_sync_;
+  int queue_size_;
+  bool approximate_sync_enabled_;
+
+  // latency budget, older tuples are dropped
+  InputAgeFilter input_age_filter_;
+
+  // for sync checking
+  ros::WallTimer check_synced_timer_;
+  int left_received_, left_info_received_, disparity_received_, all_received_;
+
+  // for sync checking
+  static void increment(int* value)
+  {
+    ++(*value);
+  }
+
+  void dataCb(const sensor_msgs::ImageConstPtr& l_image_msg,
+              const sensor_msgs::CameraInfoConstPtr& l_info_msg,
+              const stereo_msgs::DisparityImageConstPtr& disparity_msg)
+  {
+ 
+    // For sync error checking
+    ++all_received_; 
+
+    // drop tuples that cannot be processed within the latency budget
+    if (!input_age_filter_.accept(l_image_msg->header.stamp)) return;
+
+    // call implementation
+    imageCallback(l_image_msg, l_info_msg, disparity_msg);
+  }
+
+  void checkInputsSynchronized()
+  {
+    int threshold = 3 * all_received_;
+    if (left_received_ >= threshold || left_info_received_ >= threshold || 
+        disparity_received_ >= threshold) {
+      ROS_WARN("[disparity_processor] Low number of synchronized left/left_info/disparity tuples received.\n"
+               "Left images received:       %d (topic '%s')\n"
+               "Left camera info received:  %d (topic '%s')\n"
+               "Disparity images received:  %d (topic '%s')\n"
+               "Synchronized tuples: %d\n"
+               "Possible issues:\n"
+               "\t* stereo_image_proc is not running.\n"
+               "\t  Does `rosnode info %s` show any connections?\n"
+               "\t* The disparity image is computed from images other than the left image.\n"
+               "\t  Try restarting the node with parameter _approximate_sync:=True\n"
+               "\t* The network is too slow. One or more images are dropped from each tuple.\n"
+               "\t  Try restarting the node, increasing parameter 'queue_size' (currently %d)",
+               left_received_, left_sub_.getTopic().c_str(),
+               left_info_received_, left_info_sub_.getTopic().c_str(),
+               disparity_received_, disparity_sub_.getTopic().c_str(),
+               all_received_, ros::this_node::getName().c_str(), queue_size_);
+    }
+  }
+
+
+protected:
+
+  /**
+   * Constructor, reads parameters. Input topics are not subscribed before
+   * subscribe() is called, which has to be done by the implementing class
+   * once it is fully constructed.
+   * \param nh Node handle used to resolve and subscribe to input topics
+   * \param local_nh Private node handle used to read parameters
+   * \param transport The image transport to use
+   */
+  DisparityProcessor(const ros::NodeHandle& nh, const ros::NodeHandle& local_nh,
+      const std::string& transport) :
+    nh_(nh), local_nh_(local_nh), transport_(transport), input_age_filter_(local_nh),
+    left_received_(0), left_info_received_(0), disparity_received_(0), all_received_(0)
+  {
+    // Read local parameters
+    local_nh_.param("queue_size", queue_size_, 5);
+    local_nh_.param("approximate_sync", approximate_sync_enabled_, false);
+  }
+
+  /**
+   * Subscribes to input topics and registers callbacks. Callbacks may be
+   * called as soon as this method returns (e.g. from a nodelet manager's
+   * worker threads).
+   */
+  void subscribe()
+  {
+    // Resolve topic names
+    std::string stereo_ns = nh_.resolveName("stereo");
+    std::string left_topic = ros::names::clean(stereo_ns + "/left/" + nh_.resolveName("image"));
+    std::string left_info_topic = stereo_ns + "/left/camera_info";
+    std::string disparity_topic = stereo_ns + "/disparity";
+
+    // Subscribe to three input topics.
+    ROS_INFO("Subscribing to:\n\t* %s\n\t* %s\n\t* %s", 
+        left_topic.c_str(), left_info_topic.c_str(), disparity_topic.c_str());
+
+    image_transport::ImageTransport it(nh_);
+    left_sub_.subscribe(it, left_topic, 1, transport_);
+    left_info_sub_.subscribe(nh_, left_info_topic, 1);
+    disparity_sub_.subscribe(nh_, disparity_topic, 1);
+
+    // Complain every 15s if the topics appear unsynchronized
+    left_sub_.registerCallback(boost::bind(DisparityProcessor::increment, &left_received_));
+    left_info_sub_.registerCallback(boost::bind(DisparityProcessor::increment, &left_info_received_));
+    disparity_sub_.registerCallback(boost::bind(DisparityProcessor::increment, &disparity_received_));
+    check_synced_timer_ = nh_.createWallTimer(ros::WallDuration(15.0),
+                                              boost::bind(&DisparityProcessor::checkInputsSynchronized, this));
+
+    // Synchronize input topics. Optionally do approximate synchronization.
+    if (approximate_sync_enabled_)
+    {
+      approximate_sync_.reset(new ApproximateSync(ApproximatePolicy(queue_size_),
+                                                  left_sub_, left_info_sub_, disparity_sub_) );
+      approximate_sync_->registerCallback(boost::bind(&DisparityProcessor::dataCb, this, _1, _2, _3));
+    }
+    else
+    {
+      exact_sync_.reset(new ExactSync(ExactPolicy(queue_size_),
+                                      left_sub_, left_info_sub_, disparity_sub_) );
+      exact_sync_->registerCallback(boost::bind(&DisparityProcessor::dataCb, this, _1, _2, _3));
+    }
+  }
+
+  /**
+   * Shuts down the subscriptions, once this returns no callback is
+   * running or will be called. Implementing classes have to call this
+   * first thing in their destructor, as the processor is destroyed
+   * after them.
+   */
+  void unsubscribe()
+  {
+    check_synced_timer_.stop();
+    left_sub_.unsubscribe();
+    left_info_sub_.unsubscribe();
+    disparity_sub_.unsubscribe();
+    exact_sync_.reset();
+    approximate_sync_.reset();
+  }
+
+  /**
+   * Returns the number of synchronized input tuples that have been
+   * dropped because they were older than ~max_input_age.
+   */
+  int getNumDroppedInputs() const
+  {
+    return input_age_filter_.numDropped();
+  }
+
+  /**
+   * Implement this method in sub-classes 
+   */
+  virtual void imageCallback(const sensor_msgs::ImageConstPtr& l_image_msg,
+                             const sensor_msgs::CameraInfoConstPtr& l_info_msg,
+                             const stereo_msgs::DisparityImageConstPtr& disparity_msg) = 0;
+
+};
+
+} // end of namespace
+
+#endif
+
@@ -0,0 +1,267 @@
+#ifndef EVALUATION_H_
+#define EVALUATION_H_
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <iomanip>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <Eigen/Geometry>
+#include <Eigen/StdVector>
+
+#include <fovis_ros/FovisInfo.h>
+
+#include "offline_odometer.hpp"
+#include "dataset_reader.hpp"
+
+namespace fovis_ros
+{
+
+/**
+ * Collects timing and poses of an offline run and reports throughput,
+ * latency percentiles and histogram, absolute trajectory error (ATE)
+ * and relative pose error (RPE).
+ */
+class Evaluation
+{
+
+public:
+
+  /**
+   * \param histogram_bin_width width of the bins of the latency
+   *        histogram in seconds
+   */
+  explicit Evaluation(double histogram_bin_width = 0.005) :
+    histogram_bin_width_(histogram_bin_width),
+    num_failures_(0)
+  {
+  }
+
+  /**
+   * Feeds all frames of reader to odometer and adds them.
+   * \param max_frames maximum number of frames to process, 0 for all
+   * \param trajectory if not NULL, the estimated camera poses are
+   *        written to this stream in TUM format
+   * \return number of processed frames
+   */
+  int run(DatasetReader& reader, OfflineOdometer& odometer,
+      int max_frames = 0, std::ostream* trajectory = NULL)
+  {
+    DatasetFrame frame;
+    int num_frames = 0;
+    while ((max_frames <= 0 || num_frames < max_frames) && reader.read(frame))
+    {
+      bool ok = frame.stereo ?
+        odometer.processStereo(frame.images[0], frame.images[1],
+            frame.infos[0], frame.infos[1]) :
+        odometer.processMonoDepth(frame.images[0], frame.images[1],
+            frame.infos[0], frame.infos[1]);
+      if (!ok)
+      {
+        ROS_WARN("Could not process frame %d.", num_frames);
+        continue;
+      }
+      ++num_frames;
+      add(odometer.getInfo(), odometer.getPose(),
+          frame.has_ground_truth ? &frame.ground_truth : NULL);
+      if (trajectory)
+      {
+        const Eigen::Isometry3d& pose = odometer.getPose();
+        Eigen::Quaterniond rotation(pose.rotation());
+        *trajectory << std::fixed << std::setprecision(9)
+                    << frame.images[0]->header.stamp.toSec() << " "
+                    << pose.translation().x() << " "
+                    << pose.translation().y() << " "
+                    << pose.translation().z() << " "
+                    << rotation.x() << " " << rotation.y() << " "
+                    << rotation.z() << " " << rotation.w() << std::endl;
+      }
+    }
+    return num_frames;
+  }
+
+  /**
+   * Adds a processed frame.
+   * \param estimated_pose pose estimated by the odometer
+   * \param true_pose ground truth pose, NULL if not known for this frame
+   */
+  void add(const FovisInfo& info, const Eigen::Isometry3d& estimated_pose,
+      const Eigen::Isometry3d* true_pose)
+  {
+    conversion_time_.push_back(info.conversion_time);
+    depth_update_time_.push_back(info.depth_update_time);
+    process_frame_time_.push_back(info.process_frame_time);
+    runtime_.push_back(info.runtime);
+    // the first frame never has a motion estimate
+    if (runtime_.size() > 1 && !info.motion_estimate_valid) ++num_failures_;
+    if (true_pose)
+    {
+      estimated_poses_.push_back(estimated_pose);
+      true_poses_.push_back(*true_pose);
+    }
+  }
+
+  void print(const std::string& name) const
+  {
+    double total = 0.0;
+    for (size_t i = 0; i < runtime_.size(); ++i) total += runtime_[i];
+    printf("%s: %d frames, %.1f frames/s, %d motion estimate failures\n",
+        name.c_str(), static_cast<int>(runtime_.size()),
+        total > 0.0 ? runtime_.size() / total : 0.0, num_failures_);
+
+    printf("  %-20s %8s %8s %8s %8s\n", "latency [ms]", "p50", "p90", "p99", "max");
+    printTiming("conversion", conversion_time_);
+    printTiming("depth update", depth_update_time_);
+    printTiming("processFrame", process_frame_time_);
+    printTiming("total", runtime_);
+    printHistogram();
+
+    if (true_poses_.size() < 2)
+    {
+      printf("  no ground truth\n");
+      return;
+    }
+    printf("  ATE: %.4f m (RMSE over %d poses)\n",
+        absoluteTrajectoryError(), static_cast<int>(true_poses_.size()));
+    double translation_error, rotation_error;
+    relativePoseError(translation_error, rotation_error);
+    printf("  RPE: %.2f mm, %.3f deg per frame (RMSE)\n",
+        1000.0 * translation_error, rotation_error);
+    double length = pathLength();
+    double drift = finalDrift();
+    printf("  final drift: %.3f m after %.2f m (%.2f%%)\n", drift, length,
+        length > 0.0 ? 100.0 * drift / length : 0.0);
+  }
+
+  /**
+   * RMSE of the translations after rigidly aligning the estimated
+   * trajectory to the ground truth.
+   */
+  double absoluteTrajectoryError() const
+  {
+    const int n = true_poses_.size();
+    Eigen::Matrix3Xd estimated(3, n), truth(3, n);
+    for (int i = 0; i < n; ++i)
+    {
+      estimated.col(i) = estimated_poses_[i].translation();
+      truth.col(i) = true_poses_[i].translation();
+    }
+    Eigen::Matrix4d alignment = Eigen::umeyama(estimated, truth, false);
+    Eigen::Matrix3Xd aligned = (alignment.topLeftCorner<3, 3>() * estimated).colwise()
+      + alignment.topRightCorner<3, 1>();
+    return std::sqrt((aligned - truth).colwise().squaredNorm().mean());
+  }
+
+  /**
+   * RMSE of the translational and rotational (in degrees) error between
+   * consecutive poses.
+   */
+  void relativePoseError(double& translation_error, double& rotation_error) const
+  {
+    double translation_sum = 0.0, rotation_sum = 0.0;
+    for (size_t i = 1; i < true_poses_.size(); ++i)
+    {
+      Eigen::Isometry3d error =
+        (true_poses_[i - 1].inverse() * true_poses_[i]).inverse() *
+        (estimated_poses_[i - 1].inverse() * estimated_poses_[i]);
+      double angle = Eigen::AngleAxisd(error.rotation()).angle() * 180.0 / M_PI;
+      translation_sum += error.translation().squaredNorm();
+      rotation_sum += angle * angle;
+    }
+    const int n = true_poses_.size() - 1;
+    translation_error = std::sqrt(translation_sum / n);
+    rotation_error = std::sqrt(rotation_sum / n);
+  }
+
+  /**
+   * Distance between estimated and true position of the last frame, both
+   * relative to the first frame.
+   */
+  double finalDrift() const
+  {
+    Eigen::Isometry3d true_motion =
+      true_poses_.front().inverse() * true_poses_.back();
+    Eigen::Isometry3d estimated_motion =
+      estimated_poses_.front().inverse() * estimated_poses_.back();
+    return (true_motion.inverse() * estimated_motion).translation().norm();
+  }
+
+  double pathLength() const
+  {
+    double length = 0.0;
+    for (size_t i = 1; i < true_poses_.size(); ++i)
+    {
+      length += (true_poses_[i].translation() -
+          true_poses_[i - 1].translation()).norm();
+    }
+    return length;
+  }
+
+private:
+
+  typedef std::vector<Eigen::Isometry3d,
+          Eigen::aligned_allocator<Eigen::Isometry3d> > PoseVector;
+
+  static double percentile(std::vector<double> values, double p)
+  {
+    if (values.empty()) return 0.0;
+    size_t index = std::min(values.size() - 1,
+        static_cast<size_t>(p / 100.0 * values.size()));
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+  }
+
+  static void printTiming(const char* name, const std::vector<double>& times)
+  {
+    printf("  %-20s %8.2f %8.2f %8.2f %8.2f\n", name,
+        1000.0 * percentile(times, 50.0), 1000.0 * percentile(times, 90.0),
+        1000.0 * percentile(times, 99.0), 1000.0 * percentile(times, 100.0));
+  }
+
+  void printHistogram() const
+  {
+    static const int kNumBins = 20;
+    static const int kBarWidth = 50;
+    std::vector<int> bins(kNumBins + 1, 0);
+    for (size_t i = 0; i < runtime_.size(); ++i)
+    {
+      int bin = static_cast<int>(runtime_[i] / histogram_bin_width_);
+      ++bins[std::min(bin, kNumBins)];
+    }
+    int max_count = *std::max_element(bins.begin(), bins.end());
+    int last_bin = kNumBins;
+    while (last_bin > 0 && bins[last_bin] == 0) --last_bin;
+    printf("  total latency histogram [ms]:\n");
+    for (int i = 0; i <= last_bin; ++i)
+    {
+      int bar = max_count > 0 ? bins[i] * kBarWidth / max_count : 0;
+      if (i < kNumBins)
+      {
+        printf("  %6.1f-%6.1f %6d %s\n", 1000.0 * i * histogram_bin_width_,
+            1000.0 * (i + 1) * histogram_bin_width_, bins[i],
+            std::string(bar, '#').c_str());
+      }
+      else
+      {
+        printf("  %6.1f-       %6d %s\n", 1000.0 * i * histogram_bin_width_,
+            bins[i], std::string(bar, '#').c_str());
+      }
+    }
+  }
+
+  double histogram_bin_width_;
+  std::vector<double> conversion_time_;
+  std::vector<double> depth_update_time_;
+  std::vector<double> process_frame_time_;
+  std::vector<double> runtime_;
+  int num_failures_;
+  PoseVector estimated_poses_;
+  PoseVector true_poses_;
+};
+
+} // end of namespace
+
+#endif
@@ -0,0 +1,145 @@
+#ifndef FEATURE_IMAGE_WORKER_H_
+#define FEATURE_IMAGE_WORKER_H_
+
+#ifdef __linux__
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <ros/ros.h>
+#include <sensor_msgs/image_encodings.h>
+#include <image_transport/image_transport.h>
+#include <cv_bridge/cv_bridge.h>
+
+#include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+#include "visualization.hpp"
+
+namespace fovis_ros
+{
+
+/**
+ * Renders and publishes feature images in a low priority thread of its
+ * own. The odometry thread only copies a visualization::Snapshot, frames
+ * arriving while the worker is busy or faster than the maximum rate are
+ * not painted.
+ */
+class FeatureImageWorker
+{
+
+public:
+
+  /**
+   * \param publisher publisher for the feature images
+   * \param max_rate maximum publishing rate in Hz, 0 for no limit
+   * \param scale scale factor applied to the feature images
+   */
+  FeatureImageWorker(const image_transport::Publisher& publisher,
+      double max_rate, double scale) :
+    publisher_(publisher),
+    min_interval_(max_rate > 0.0 ? 1.0 / max_rate : 0.0),
+    scale_(scale),
+    busy_(0),
+    stop_(false)
+  {
+    thread_.reset(new boost::thread(
+          boost::bind(&FeatureImageWorker::workLoop, this)));
+  }
+
+  ~FeatureImageWorker()
+  {
+    {
+      boost::lock_guard<boost::mutex> lock(mutex_);
+      stop_ = true;
+      condition_.notify_all();
+    }
+    thread_->join();
+  }
+
+  /**
+   * Returns true if a feature image should be painted for the current
+   * frame, i.e. there are subscribers, the worker is idle and the
+   * minimum interval has passed. If so, the caller has to fill
+   * snapshot() and call submit().
+   */
+  bool ready() const
+  {
+    if (busy_) return false;
+    // pairs with the release of the mutex by the worker thread
+    __sync_synchronize();
+    if (publisher_.getNumSubscribers() == 0) return false;
+    return (ros::WallTime::now() - last_submit_time_).toSec() >= min_interval_;
+  }
+
+  visualization::Snapshot& snapshot()
+  {
+    return snapshot_;
+  }
+
+  /**
+   * Hands the snapshot over to the worker thread.
+   * \param header header of the image the snapshot was taken for
+   */
+  void submit(const std_msgs::Header& header)
+  {
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    header_ = header;
+    last_submit_time_ = ros::WallTime::now();
+    busy_ = 1;
+    condition_.notify_all();
+  }
+
+private:
+
+  void workLoop()
+  {
+#ifdef __linux__
+    // on linux, nice values are per thread
+    setpriority(PRIO_PROCESS, syscall(SYS_gettid), 19);
+#endif
+    boost::unique_lock<boost::mutex> lock(mutex_);
+    while (true)
+    {
+      while (!stop_ && !busy_)
+        condition_.wait(lock);
+      if (stop_) return;
+      lock.unlock();
+
+      cv_bridge::CvImage cv_image;
+      cv_image.header.stamp = header_.stamp;
+      cv_image.header.frame_id = header_.frame_id;
+      cv_image.encoding = sensor_msgs::image_encodings::BGR8;
+      cv_image.image = visualization::paint(snapshot_, scale_);
+      publisher_.publish(cv_image.toImageMsg());
+
+      lock.lock();
+      busy_ = 0;
+    }
+  }
+
+  image_transport::Publisher publisher_;
+  double min_interval_;
+  double scale_;
+
+  // owned by the odometry thread while busy_ is 0,
+  // by the worker thread otherwise
+  visualization::Snapshot snapshot_;
+  std_msgs::Header header_;
+  ros::WallTime last_submit_time_;
+
+  volatile int busy_;
+  bool stop_;
+  boost::mutex mutex_;
+  boost::condition_variable condition_;
+  boost::scoped_ptr<boost::thread> thread_;
+};
+
+} // end of namespace
+
+#endif
@@ -0,0 +1,78 @@
+#include <ros/ros.h>
+#include <opencv2/highgui/highgui.hpp>
+
+#include <fovis_ros/FovisFeatures.h>
+
+#include "visualization.hpp"
+
+namespace
+{
+
+const char* kWindowName = "fovis features";
+
+/**
+ * Renders the feature data messages of an odometer on the client side,
+ * so that the odometer does not have to paint and send images.
+ */
+class FeaturesViewer
+{
+
+public:
+
+  explicit FeaturesViewer(double scale) : scale_(scale), has_image_(false)
+  {
+  }
+
+  void callback(const fovis_ros::FovisFeaturesConstPtr& msg)
+  {
+    fovis_ros::visualization::fromMsg(*msg, snapshot_);
+    image_ = fovis_ros::visualization::paint(snapshot_, scale_);
+    has_image_ = true;
+  }
+
+  void show()
+  {
+    if (has_image_)
+    {
+      cv::imshow(kWindowName, image_);
+      has_image_ = false;
+    }
+  }
+
+private:
+
+  double scale_;
+  fovis_ros::visualization::Snapshot snapshot_;
+  cv::Mat image_;
+  bool has_image_;
+};
+
+} // end of anonymous namespace
+
+int main(int argc, char **argv)
+{
+  ros::init(argc, argv, "features_viewer");
+  if (ros::names::remap("features") == "features") {
+    ROS_WARN("'features' has not been remapped! Example command-line usage:\n"
+             "\t$ rosrun fovis_ros fovis_features_viewer features:=/stereo_odometer/feature_data");
+  }
+
+  ros::NodeHandle nh;
+  ros::NodeHandle local_nh("~");
+  double scale;
+  local_nh.param("scale", scale, 0.5);
+  FeaturesViewer viewer(scale);
+  ros::Subscriber sub = nh.subscribe("features", 1,
+      &FeaturesViewer::callback, &viewer);
+
+  cv::namedWindow(kWindowName);
+  // HighGUI wants to be driven from the main thread
+  while (ros::ok())
+  {
+    ros::spinOnce();
+    viewer.show();
+    cv::waitKey(10);
+  }
+  cv::destroyWindow(kWindowName);
+  return 0;
+}
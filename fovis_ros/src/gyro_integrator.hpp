@@ -0,0 +1,131 @@
+#ifndef GYRO_INTEGRATOR_H_
+#define GYRO_INTEGRATOR_H_
+
+#include <algorithm>
+#include <deque>
+#include <string>
+
+#include <sensor_msgs/Imu.h>
+
+#include <Eigen/Geometry>
+
+#include "spsc_queue.hpp"
+
+namespace fovis_ros
+{
+
+/**
+ * Integrates the angular velocity of an IMU between two points in time.
+ * Samples are pushed by the IMU callback and handed over to the thread
+ * that integrates through a lock-free ring buffer, so the callback never
+ * waits for the odometer. Exactly one thread may push and one may
+ * integrate.
+ */
+class GyroIntegrator
+{
+
+public:
+
+  /**
+   * \param capacity number of samples the ring buffer holds, samples
+   *        that arrive while it is full are dropped
+   */
+  explicit GyroIntegrator(size_t capacity = 1000) :
+    queue_(capacity),
+    frame_id_known_(false),
+    num_dropped_samples_(0)
+  {
+  }
+
+  /**
+   * Producer side, called for every IMU message.
+   */
+  void push(const sensor_msgs::Imu& imu_msg)
+  {
+    if (!frame_id_known_)
+    {
+      frame_id_ = imu_msg.header.frame_id;
+      __sync_synchronize();
+      frame_id_known_ = true;
+    }
+    Sample sample;
+    sample.stamp = imu_msg.header.stamp.toSec();
+    sample.rate = Eigen::Vector3d(imu_msg.angular_velocity.x,
+        imu_msg.angular_velocity.y, imu_msg.angular_velocity.z);
+    if (!queue_.tryPush(sample)) __sync_fetch_and_add(&num_dropped_samples_, 1);
+  }
+
+  /**
+   * Consumer side: integrates the angular velocity from time from to time
+   * to, assuming it changes linearly between samples.
+   * \param rotation orientation of the IMU at to relative to its
+   *        orientation at from
+   * \return false if the samples received so far do not cover the
+   *         interval
+   */
+  bool integrate(double from, double to, Eigen::Quaterniond& rotation)
+  {
+    Sample sample;
+    while (queue_.tryPop(sample)) history_.push_back(sample);
+    // keep the last sample before from, it bounds the interval
+    while (history_.size() > 1 && history_[1].stamp <= from)
+      history_.pop_front();
+    if (history_.size() < 2 || history_.front().stamp > from ||
+        history_.back().stamp < to)
+      return false;
+
+    rotation.setIdentity();
+    for (size_t i = 0; i + 1 < history_.size() && history_[i].stamp < to; ++i)
+    {
+      const Sample& s0 = history_[i];
+      const Sample& s1 = history_[i + 1];
+      double dt = s1.stamp - s0.stamp;
+      if (dt <= 0.0) continue;
+      double t0 = std::max(s0.stamp, from);
+      double t1 = std::min(s1.stamp, to);
+      if (t1 <= t0) continue;
+      // rate at the middle of the clipped segment
+      double alpha = (0.5 * (t0 + t1) - s0.stamp) / dt;
+      Eigen::Vector3d angle = ((1.0 - alpha) * s0.rate + alpha * s1.rate) * (t1 - t0);
+      double norm = angle.norm();
+      if (norm > 0.0)
+        rotation = rotation * Eigen::Quaterniond(Eigen::AngleAxisd(norm, angle / norm));
+    }
+    rotation.normalize();
+    return true;
+  }
+
+  /**
+   * Frame id of the IMU messages, only valid once integrate() succeeded.
+   */
+  const std::string& frameId() const
+  {
+    return frame_id_;
+  }
+
+  int numDroppedSamples() const
+  {
+    return num_dropped_samples_;
+  }
+
+private:
+
+  struct Sample
+  {
+    double stamp;
+    Eigen::Vector3d rate;
+  };
+
+  SpscQueue<Sample> queue_;
+  // samples taken from the queue, only accessed by the consumer
+  std::deque<Sample> history_;
+
+  // set once by the producer before the first sample is pushed
+  std::string frame_id_;
+  volatile bool frame_id_known_;
+  volatile int num_dropped_samples_;
+};
+
+} // end of namespace
+
+#endif
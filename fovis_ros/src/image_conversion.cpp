@@ -0,0 +1,749 @@
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define FOVIS_ROS_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define FOVIS_ROS_NEON
+#include <arm_neon.h>
+#endif
+
+#include <sensor_msgs/image_encodings.h>
+
+#include "image_conversion.hpp"
+
+// Every kernel has a portable implementation and optional SIMD variants.
+// The x86 variants are compiled with function specific target attributes
+// so that the package itself is built for the baseline of the platform,
+// the best variant the CPU supports is chosen once at runtime. NEON is
+// part of the aarch64 baseline and selected at compile time.
+
+namespace
+{
+
+typedef void (*DepthKernel)(const uint16_t* src, int width, float* dst);
+typedef void (*GrayToBgrKernel)(const uint8_t* src, int width, uint8_t* dst);
+typedef void (*RemapKernel)(const uint8_t* src, int src_step,
+    const int32_t* offsets, const uint8_t* x_weights, const int16_t* y_weights,
+    int width, uint8_t* dst);
+typedef void (*ToGrayKernel)(const uint8_t* src, int width, uint8_t* dst);
+typedef void (*BayerToGrayKernel)(const uint8_t* above, const uint8_t* row,
+    const uint8_t* below, int width, uint8_t* dst);
+
+/**
+ * Row kernels of one instruction set. Each kernel converts a single
+ * row, the callers iterate over the (strided) rows.
+ */
+struct Kernels
+{
+  const char* name;
+  DepthKernel depth_millimetres_to_metres;
+  GrayToBgrKernel gray_to_bgr;
+  RemapKernel remap;
+  ToGrayKernel bgr_to_gray;
+  ToGrayKernel rgb_to_gray;
+  // src points to the first Y value of the row
+  ToGrayKernel yuv422_to_gray;
+  BayerToGrayKernel bayer_to_gray;
+};
+
+// remap weights have 6 fractional bits, the result of the horizontal
+// pass fits 16 bits and that of the vertical pass has 12
+const int REMAP_BITS = 6;
+const int REMAP_ONE = 1 << REMAP_BITS;
+
+// luminance weights of OpenCV's color conversions with 14 fractional
+// bits, so that the results are the same as those of cv_bridge
+const int GRAY_BITS = 14;
+const int GRAY_R = 4899;
+const int GRAY_G = 9617;
+const int GRAY_B = 1868;
+
+void depthRowScalar(const uint16_t* src, int width, float* dst)
+{
+  const float nan = std::numeric_limits<float>::quiet_NaN();
+  for (int u = 0; u < width; ++u)
+  {
+    dst[u] = src[u] == 0 ? nan : src[u] * 0.001f;
+  }
+}
+
+void grayToBgrRowScalar(const uint8_t* src, int width, uint8_t* dst)
+{
+  for (int u = 0; u < width; ++u)
+  {
+    dst[0] = dst[1] = dst[2] = src[u];
+    dst += 3;
+  }
+}
+
+template<bool BGR>
+void colorToGrayRowScalar(const uint8_t* src, int width, uint8_t* dst)
+{
+  const int first = BGR ? GRAY_B : GRAY_R;
+  const int third = BGR ? GRAY_R : GRAY_B;
+  for (int u = 0; u < width; ++u)
+  {
+    dst[u] = (src[0] * first + src[1] * GRAY_G + src[2] * third +
+        (1 << (GRAY_BITS - 1))) >> GRAY_BITS;
+    src += 3;
+  }
+}
+
+void yuv422ToGrayRowScalar(const uint8_t* src, int width, uint8_t* dst)
+{
+  for (int u = 0; u < width; ++u)
+  {
+    dst[u] = src[2 * u];
+  }
+}
+
+// Bayer images are filtered with the 3x3 binomial kernel, which covers
+// every color in the ratio 1:2:1 (R:G:B) at every pixel, regardless of
+// the pattern. No demosaicing is needed for gray, and the result is
+// centered on the pixels. Columns are reflected at the borders.
+void bayerToGrayRangeScalar(const uint8_t* above, const uint8_t* row,
+    const uint8_t* below, int width, int begin, int end, uint8_t* dst)
+{
+  for (int u = begin; u < end; ++u)
+  {
+    const int left = u > 0 ? u - 1 : 1;
+    const int right = u < width - 1 ? u + 1 : width - 2;
+    const int sum =
+      above[left] + 2 * row[left] + below[left] +
+      2 * (above[u] + 2 * row[u] + below[u]) +
+      above[right] + 2 * row[right] + below[right];
+    dst[u] = (sum + 8) >> 4;
+  }
+}
+
+void bayerToGrayRowScalar(const uint8_t* above, const uint8_t* row,
+    const uint8_t* below, int width, uint8_t* dst)
+{
+  bayerToGrayRangeScalar(above, row, below, width, 0, width, dst);
+}
+
+void remapRowScalar(const uint8_t* src, int src_step, const int32_t* offsets,
+    const uint8_t* x_weights, const int16_t* y_weights, int width, uint8_t* dst)
+{
+  for (int u = 0; u < width; ++u)
+  {
+    const uint8_t* p = src + offsets[u];
+    int top = p[0] * x_weights[2 * u] + p[1] * x_weights[2 * u + 1];
+    int bottom = p[src_step] * x_weights[2 * u] +
+      p[src_step + 1] * x_weights[2 * u + 1];
+    dst[u] = (top * y_weights[2 * u] + bottom * y_weights[2 * u + 1] +
+        (1 << (2 * REMAP_BITS - 1))) >> (2 * REMAP_BITS);
+  }
+}
+
+#ifdef FOVIS_ROS_X86_DISPATCH
+
+__attribute__((target("sse2")))
+void depthRowSse2(const uint16_t* src, int width, float* dst)
+{
+  const __m128i zero = _mm_setzero_si128();
+  const __m128 scale = _mm_set1_ps(0.001f);
+  const __m128 nans = _mm_set1_ps(std::numeric_limits<float>::quiet_NaN());
+  int u = 0;
+  for (; u + 8 <= width; u += 8)
+  {
+    __m128i raw = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + u));
+    __m128i invalid = _mm_cmpeq_epi16(raw, zero);
+    __m128 lo = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(raw, zero)), scale);
+    __m128 hi = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(raw, zero)), scale);
+    // widen the 16 bit zero mask to 32 bit lanes and select NaN there
+    __m128 invalid_lo = _mm_castsi128_ps(_mm_unpacklo_epi16(invalid, invalid));
+    __m128 invalid_hi = _mm_castsi128_ps(_mm_unpackhi_epi16(invalid, invalid));
+    lo = _mm_or_ps(_mm_and_ps(invalid_lo, nans), _mm_andnot_ps(invalid_lo, lo));
+    hi = _mm_or_ps(_mm_and_ps(invalid_hi, nans), _mm_andnot_ps(invalid_hi, hi));
+    _mm_storeu_ps(dst + u, lo);
+    _mm_storeu_ps(dst + u + 4, hi);
+  }
+  depthRowScalar(src + u, width - u, dst + u);
+}
+
+__attribute__((target("avx2")))
+void depthRowAvx2(const uint16_t* src, int width, float* dst)
+{
+  const __m256 scale = _mm256_set1_ps(0.001f);
+  const __m256 nans = _mm256_set1_ps(std::numeric_limits<float>::quiet_NaN());
+  const __m256i zero = _mm256_setzero_si256();
+  int u = 0;
+  for (; u + 16 <= width; u += 16)
+  {
+    __m128i raw_lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + u));
+    __m128i raw_hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + u + 8));
+    __m256i wide_lo = _mm256_cvtepu16_epi32(raw_lo);
+    __m256i wide_hi = _mm256_cvtepu16_epi32(raw_hi);
+    __m256 lo = _mm256_mul_ps(_mm256_cvtepi32_ps(wide_lo), scale);
+    __m256 hi = _mm256_mul_ps(_mm256_cvtepi32_ps(wide_hi), scale);
+    lo = _mm256_blendv_ps(lo, nans,
+        _mm256_castsi256_ps(_mm256_cmpeq_epi32(wide_lo, zero)));
+    hi = _mm256_blendv_ps(hi, nans,
+        _mm256_castsi256_ps(_mm256_cmpeq_epi32(wide_hi, zero)));
+    _mm256_storeu_ps(dst + u, lo);
+    _mm256_storeu_ps(dst + u + 8, hi);
+  }
+  depthRowScalar(src + u, width - u, dst + u);
+}
+
+// SSE2 has no byte shuffle, the interleaving needs pshufb which every
+// AVX2 capable CPU has
+__attribute__((target("avx2")))
+void grayToBgrRowAvx2(const uint8_t* src, int width, uint8_t* dst)
+{
+  const __m128i shuffle0 = _mm_setr_epi8(
+      0, 0, 0, 1, 1, 1, 2, 2, 2, 3, 3, 3, 4, 4, 4, 5);
+  const __m128i shuffle1 = _mm_setr_epi8(
+      5, 5, 6, 6, 6, 7, 7, 7, 8, 8, 8, 9, 9, 9, 10, 10);
+  const __m128i shuffle2 = _mm_setr_epi8(
+      10, 11, 11, 11, 12, 12, 12, 13, 13, 13, 14, 14, 14, 15, 15, 15);
+  int u = 0;
+  for (; u + 16 <= width; u += 16)
+  {
+    __m128i gray = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + u));
+    __m128i* out = reinterpret_cast<__m128i*>(dst + 3 * u);
+    _mm_storeu_si128(out, _mm_shuffle_epi8(gray, shuffle0));
+    _mm_storeu_si128(out + 1, _mm_shuffle_epi8(gray, shuffle1));
+    _mm_storeu_si128(out + 2, _mm_shuffle_epi8(gray, shuffle2));
+  }
+  grayToBgrRowScalar(src + u, width - u, dst + 3 * u);
+}
+
+// gathers the 2x2 neighbourhoods of 8 pixels with two 4 byte gathers,
+// the interpolation is a multiply-add of bytes followed by one of words
+__attribute__((target("avx2")))
+void remapRowAvx2(const uint8_t* src, int src_step, const int32_t* offsets,
+    const uint8_t* x_weights, const int16_t* y_weights, int width, uint8_t* dst)
+{
+  const __m256i low_words = _mm256_set1_epi32(0xffff);
+  const __m256i round = _mm256_set1_epi32(1 << (2 * REMAP_BITS - 1));
+  const int* top_row = reinterpret_cast<const int*>(src);
+  const int* bottom_row = reinterpret_cast<const int*>(src + src_step);
+  int u = 0;
+  for (; u + 8 <= width; u += 8)
+  {
+    __m256i offset = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(offsets + u));
+    __m256i top = _mm256_i32gather_epi32(top_row, offset, 1);
+    __m256i bottom = _mm256_i32gather_epi32(bottom_row, offset, 1);
+    // bytes of each lane: top left, top right, bottom left, bottom right
+    __m256i pixels = _mm256_or_si256(_mm256_and_si256(top, low_words),
+        _mm256_slli_epi32(bottom, 16));
+    // both horizontal weights for the top and the bottom pair
+    __m256i x_weight = _mm256_cvtepu16_epi32(_mm_loadu_si128(
+          reinterpret_cast<const __m128i*>(x_weights + 2 * u)));
+    x_weight = _mm256_or_si256(x_weight, _mm256_slli_epi32(x_weight, 16));
+    __m256i y_weight = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(y_weights + 2 * u));
+    __m256i rows = _mm256_maddubs_epi16(pixels, x_weight);
+    __m256i values = _mm256_srli_epi32(_mm256_add_epi32(
+          _mm256_madd_epi16(rows, y_weight), round), 2 * REMAP_BITS);
+    __m128i words = _mm_packus_epi32(_mm256_castsi256_si128(values),
+        _mm256_extracti128_si256(values, 1));
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + u),
+        _mm_packus_epi16(words, words));
+  }
+  remapRowScalar(src, src_step, offsets + u, x_weights + 2 * u,
+      y_weights + 2 * u, width - u, dst + u);
+}
+
+__attribute__((target("sse2")))
+void yuv422ToGrayRowSse2(const uint8_t* src, int width, uint8_t* dst)
+{
+  const __m128i low_bytes = _mm_set1_epi16(0xff);
+  int u = 0;
+  // strictly less: for UYVY the last Y is the second to last byte
+  for (; u + 16 < width; u += 16)
+  {
+    const __m128i* in = reinterpret_cast<const __m128i*>(src + 2 * u);
+    __m128i lo = _mm_and_si128(_mm_loadu_si128(in), low_bytes);
+    __m128i hi = _mm_and_si128(_mm_loadu_si128(in + 1), low_bytes);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + u),
+        _mm_packus_epi16(lo, hi));
+  }
+  yuv422ToGrayRowScalar(src + 2 * u, width - u, dst + u);
+}
+
+// sum of a row and its neighbours weighted 1:2:1 of 8 pixels, as words
+__attribute__((target("sse2")))
+inline void bayerColumnsSse2(const uint8_t* above, const uint8_t* row,
+    const uint8_t* below, __m128i& lo, __m128i& hi)
+{
+  const __m128i zero = _mm_setzero_si128();
+  __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(above));
+  __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row));
+  __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(below));
+  lo = _mm_add_epi16(
+      _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(c, zero)),
+      _mm_slli_epi16(_mm_unpacklo_epi8(b, zero), 1));
+  hi = _mm_add_epi16(
+      _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(c, zero)),
+      _mm_slli_epi16(_mm_unpackhi_epi8(b, zero), 1));
+}
+
+__attribute__((target("sse2")))
+void bayerToGrayRowSse2(const uint8_t* above, const uint8_t* row,
+    const uint8_t* below, int width, uint8_t* dst)
+{
+  const __m128i round = _mm_set1_epi16(8);
+  bayerToGrayRangeScalar(above, row, below, width, 0, 1, dst);
+  int u = 1;
+  for (; u + 17 <= width; u += 16)
+  {
+    __m128i left_lo, left_hi, center_lo, center_hi, right_lo, right_hi;
+    bayerColumnsSse2(above + u - 1, row + u - 1, below + u - 1, left_lo, left_hi);
+    bayerColumnsSse2(above + u, row + u, below + u, center_lo, center_hi);
+    bayerColumnsSse2(above + u + 1, row + u + 1, below + u + 1, right_lo, right_hi);
+    __m128i lo = _mm_add_epi16(_mm_add_epi16(left_lo, right_lo),
+        _mm_add_epi16(_mm_slli_epi16(center_lo, 1), round));
+    __m128i hi = _mm_add_epi16(_mm_add_epi16(left_hi, right_hi),
+        _mm_add_epi16(_mm_slli_epi16(center_hi, 1), round));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + u), _mm_packus_epi16(
+          _mm_srli_epi16(lo, 4), _mm_srli_epi16(hi, 4)));
+  }
+  bayerToGrayRangeScalar(above, row, below, width, u, width, dst);
+}
+
+// byte shuffles that gather channel c of 16 interleaved 3 channel pixels
+// from the r-th of their three 16 byte blocks
+const int8_t DEINTERLEAVE3[3][3][16] = {
+  {{0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+   {-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1},
+   {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13}},
+  {{1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+   {-1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1},
+   {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14}},
+  {{2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+   {-1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1},
+   {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15}}};
+
+// deinterleaves with pshufb like grayToBgrRowAvx2 interleaves, the
+// weighted sum is a multiply-add of words: (c0, c1) with the weights of
+// both and (c2, 1) with the weight of c2 and the rounding term
+template<bool BGR>
+__attribute__((target("avx2")))
+void colorToGrayRowAvx2(const uint8_t* src, int width, uint8_t* dst)
+{
+  const int first = BGR ? GRAY_B : GRAY_R;
+  const int third = BGR ? GRAY_R : GRAY_B;
+  __m128i shuffle[3][3];
+  for (int c = 0; c < 3; ++c)
+  {
+    for (int r = 0; r < 3; ++r)
+    {
+      shuffle[c][r] = _mm_loadu_si128(
+          reinterpret_cast<const __m128i*>(DEINTERLEAVE3[c][r]));
+    }
+  }
+  const __m256i weights01 = _mm256_set1_epi32((GRAY_G << 16) | first);
+  const __m256i weights2 = _mm256_set1_epi32(
+      ((1 << (GRAY_BITS - 1)) << 16) | third);
+  const __m256i ones = _mm256_set1_epi16(1);
+  int u = 0;
+  for (; u + 16 <= width; u += 16)
+  {
+    const __m128i* in = reinterpret_cast<const __m128i*>(src + 3 * u);
+    const __m128i block[3] = {_mm_loadu_si128(in), _mm_loadu_si128(in + 1),
+      _mm_loadu_si128(in + 2)};
+    __m256i channel[3];
+    for (int c = 0; c < 3; ++c)
+    {
+      channel[c] = _mm256_cvtepu8_epi16(_mm_or_si128(
+            _mm_or_si128(_mm_shuffle_epi8(block[0], shuffle[c][0]),
+              _mm_shuffle_epi8(block[1], shuffle[c][1])),
+            _mm_shuffle_epi8(block[2], shuffle[c][2])));
+    }
+    __m256i lo = _mm256_add_epi32(
+        _mm256_madd_epi16(_mm256_unpacklo_epi16(channel[0], channel[1]), weights01),
+        _mm256_madd_epi16(_mm256_unpacklo_epi16(channel[2], ones), weights2));
+    __m256i hi = _mm256_add_epi32(
+        _mm256_madd_epi16(_mm256_unpackhi_epi16(channel[0], channel[1]), weights01),
+        _mm256_madd_epi16(_mm256_unpackhi_epi16(channel[2], ones), weights2));
+    // the unpacking and packing both work within 128 bit lanes, so the
+    // words come out in pixel order
+    __m256i words = _mm256_packus_epi32(_mm256_srli_epi32(lo, GRAY_BITS),
+        _mm256_srli_epi32(hi, GRAY_BITS));
+    __m256i bytes = _mm256_permute4x64_epi64(
+        _mm256_packus_epi16(words, words), 0x08);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + u),
+        _mm256_castsi256_si128(bytes));
+  }
+  colorToGrayRowScalar<BGR>(src + 3 * u, width - u, dst + u);
+}
+
+__attribute__((target("avx2")))
+void yuv422ToGrayRowAvx2(const uint8_t* src, int width, uint8_t* dst)
+{
+  const __m256i low_bytes = _mm256_set1_epi16(0xff);
+  int u = 0;
+  for (; u + 32 < width; u += 32)
+  {
+    const __m256i* in = reinterpret_cast<const __m256i*>(src + 2 * u);
+    __m256i lo = _mm256_and_si256(_mm256_loadu_si256(in), low_bytes);
+    __m256i hi = _mm256_and_si256(_mm256_loadu_si256(in + 1), low_bytes);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + u),
+        _mm256_permute4x64_epi64(_mm256_packus_epi16(lo, hi), 0xd8));
+  }
+  yuv422ToGrayRowScalar(src + 2 * u, width - u, dst + u);
+}
+
+__attribute__((target("avx2")))
+inline __m256i bayerColumnsAvx2(const uint8_t* above, const uint8_t* row,
+    const uint8_t* below)
+{
+  __m256i a = _mm256_cvtepu8_epi16(
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(above)));
+  __m256i b = _mm256_cvtepu8_epi16(
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(row)));
+  __m256i c = _mm256_cvtepu8_epi16(
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(below)));
+  return _mm256_add_epi16(_mm256_add_epi16(a, c), _mm256_slli_epi16(b, 1));
+}
+
+__attribute__((target("avx2")))
+void bayerToGrayRowAvx2(const uint8_t* above, const uint8_t* row,
+    const uint8_t* below, int width, uint8_t* dst)
+{
+  const __m256i round = _mm256_set1_epi16(8);
+  bayerToGrayRangeScalar(above, row, below, width, 0, 1, dst);
+  int u = 1;
+  for (; u + 17 <= width; u += 16)
+  {
+    __m256i left = bayerColumnsAvx2(above + u - 1, row + u - 1, below + u - 1);
+    __m256i center = bayerColumnsAvx2(above + u, row + u, below + u);
+    __m256i right = bayerColumnsAvx2(above + u + 1, row + u + 1, below + u + 1);
+    __m256i sum = _mm256_add_epi16(_mm256_add_epi16(left, right),
+        _mm256_add_epi16(_mm256_slli_epi16(center, 1), round));
+    sum = _mm256_srli_epi16(sum, 4);
+    __m256i bytes = _mm256_permute4x64_epi64(
+        _mm256_packus_epi16(sum, sum), 0x08);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + u),
+        _mm256_castsi256_si128(bytes));
+  }
+  bayerToGrayRangeScalar(above, row, below, width, u, width, dst);
+}
+
+#endif // FOVIS_ROS_X86_DISPATCH
+
+#ifdef FOVIS_ROS_NEON
+
+void depthRowNeon(const uint16_t* src, int width, float* dst)
+{
+  const float32x4_t nans = vdupq_n_f32(std::numeric_limits<float>::quiet_NaN());
+  int u = 0;
+  for (; u + 8 <= width; u += 8)
+  {
+    uint16x8_t raw = vld1q_u16(src + u);
+    uint32x4_t wide_lo = vmovl_u16(vget_low_u16(raw));
+    uint32x4_t wide_hi = vmovl_u16(vget_high_u16(raw));
+    float32x4_t lo = vmulq_n_f32(vcvtq_f32_u32(wide_lo), 0.001f);
+    float32x4_t hi = vmulq_n_f32(vcvtq_f32_u32(wide_hi), 0.001f);
+    lo = vbslq_f32(vceqq_u32(wide_lo, vdupq_n_u32(0)), nans, lo);
+    hi = vbslq_f32(vceqq_u32(wide_hi, vdupq_n_u32(0)), nans, hi);
+    vst1q_f32(dst + u, lo);
+    vst1q_f32(dst + u + 4, hi);
+  }
+  depthRowScalar(src + u, width - u, dst + u);
+}
+
+void grayToBgrRowNeon(const uint8_t* src, int width, uint8_t* dst)
+{
+  int u = 0;
+  for (; u + 16 <= width; u += 16)
+  {
+    uint8x16x3_t bgr;
+    bgr.val[0] = bgr.val[1] = bgr.val[2] = vld1q_u8(src + u);
+    vst3q_u8(dst + 3 * u, bgr);
+  }
+  grayToBgrRowScalar(src + u, width - u, dst + 3 * u);
+}
+
+template<bool BGR>
+void colorToGrayRowNeon(const uint8_t* src, int width, uint8_t* dst)
+{
+  const uint16_t first = BGR ? GRAY_B : GRAY_R;
+  const uint16_t third = BGR ? GRAY_R : GRAY_B;
+  int u = 0;
+  for (; u + 8 <= width; u += 8)
+  {
+    uint8x8x3_t pixels = vld3_u8(src + 3 * u);
+    uint16x8_t c0 = vmovl_u8(pixels.val[0]);
+    uint16x8_t c1 = vmovl_u8(pixels.val[1]);
+    uint16x8_t c2 = vmovl_u8(pixels.val[2]);
+    uint32x4_t lo = vmull_n_u16(vget_low_u16(c0), first);
+    lo = vmlal_n_u16(lo, vget_low_u16(c1), GRAY_G);
+    lo = vmlal_n_u16(lo, vget_low_u16(c2), third);
+    uint32x4_t hi = vmull_n_u16(vget_high_u16(c0), first);
+    hi = vmlal_n_u16(hi, vget_high_u16(c1), GRAY_G);
+    hi = vmlal_n_u16(hi, vget_high_u16(c2), third);
+    uint16x8_t words = vcombine_u16(
+        vrshrn_n_u32(lo, GRAY_BITS), vrshrn_n_u32(hi, GRAY_BITS));
+    vst1_u8(dst + u, vmovn_u16(words));
+  }
+  colorToGrayRowScalar<BGR>(src + 3 * u, width - u, dst + u);
+}
+
+void yuv422ToGrayRowNeon(const uint8_t* src, int width, uint8_t* dst)
+{
+  int u = 0;
+  // strictly less: for UYVY the last Y is the second to last byte
+  for (; u + 16 < width; u += 16)
+  {
+    vst1q_u8(dst + u, vld2q_u8(src + 2 * u).val[0]);
+  }
+  yuv422ToGrayRowScalar(src + 2 * u, width - u, dst + u);
+}
+
+inline uint16x8_t bayerColumnsNeon(const uint8_t* above, const uint8_t* row,
+    const uint8_t* below)
+{
+  return vaddq_u16(vaddl_u8(vld1_u8(above), vld1_u8(below)),
+      vshll_n_u8(vld1_u8(row), 1));
+}
+
+void bayerToGrayRowNeon(const uint8_t* above, const uint8_t* row,
+    const uint8_t* below, int width, uint8_t* dst)
+{
+  bayerToGrayRangeScalar(above, row, below, width, 0, 1, dst);
+  int u = 1;
+  for (; u + 9 <= width; u += 8)
+  {
+    uint16x8_t left = bayerColumnsNeon(above + u - 1, row + u - 1, below + u - 1);
+    uint16x8_t center = bayerColumnsNeon(above + u, row + u, below + u);
+    uint16x8_t right = bayerColumnsNeon(above + u + 1, row + u + 1, below + u + 1);
+    uint16x8_t sum = vaddq_u16(vaddq_u16(left, right), vshlq_n_u16(center, 1));
+    vst1_u8(dst + u, vrshrn_n_u16(sum, 4));
+  }
+  bayerToGrayRangeScalar(above, row, below, width, u, width, dst);
+}
+
+#endif // FOVIS_ROS_NEON
+
+Kernels selectKernels()
+{
+  Kernels kernels;
+  kernels.name = "scalar";
+  kernels.depth_millimetres_to_metres = depthRowScalar;
+  kernels.gray_to_bgr = grayToBgrRowScalar;
+  // without gather instructions, loading the neighbourhoods dominates
+  // and remapping stays scalar
+  kernels.remap = remapRowScalar;
+  kernels.bgr_to_gray = colorToGrayRowScalar<true>;
+  kernels.rgb_to_gray = colorToGrayRowScalar<false>;
+  kernels.yuv422_to_gray = yuv422ToGrayRowScalar;
+  kernels.bayer_to_gray = bayerToGrayRowScalar;
+#ifdef FOVIS_ROS_X86_DISPATCH
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("sse2"))
+  {
+    kernels.name = "sse2";
+    kernels.depth_millimetres_to_metres = depthRowSse2;
+    kernels.yuv422_to_gray = yuv422ToGrayRowSse2;
+    kernels.bayer_to_gray = bayerToGrayRowSse2;
+  }
+  if (__builtin_cpu_supports("avx2"))
+  {
+    kernels.name = "avx2";
+    kernels.depth_millimetres_to_metres = depthRowAvx2;
+    kernels.gray_to_bgr = grayToBgrRowAvx2;
+    kernels.remap = remapRowAvx2;
+    kernels.bgr_to_gray = colorToGrayRowAvx2<true>;
+    kernels.rgb_to_gray = colorToGrayRowAvx2<false>;
+    kernels.yuv422_to_gray = yuv422ToGrayRowAvx2;
+    kernels.bayer_to_gray = bayerToGrayRowAvx2;
+  }
+#endif
+#ifdef FOVIS_ROS_NEON
+  kernels.name = "neon";
+  kernels.depth_millimetres_to_metres = depthRowNeon;
+  kernels.gray_to_bgr = grayToBgrRowNeon;
+  kernels.bgr_to_gray = colorToGrayRowNeon<true>;
+  kernels.rgb_to_gray = colorToGrayRowNeon<false>;
+  kernels.yuv422_to_gray = yuv422ToGrayRowNeon;
+  kernels.bayer_to_gray = bayerToGrayRowNeon;
+#endif
+  return kernels;
+}
+
+const Kernels& kernels()
+{
+  static const Kernels selected = selectKernels();
+  return selected;
+}
+
+} // end of anonymous namespace
+
+
+const char* fovis_ros::image_conversion::instructionSet()
+{
+  return kernels().name;
+}
+
+void fovis_ros::image_conversion::depthMillimetresToMetres(
+    const uint16_t* src, int src_step, int width, int height, float* dst)
+{
+  DepthKernel kernel = kernels().depth_millimetres_to_metres;
+  for (int v = 0; v < height; ++v)
+  {
+    const uint16_t* src_row = reinterpret_cast<const uint16_t*>(
+        reinterpret_cast<const uint8_t*>(src) + v * src_step);
+    kernel(src_row, width, dst + v * width);
+  }
+}
+
+void fovis_ros::image_conversion::grayToBgr(const uint8_t* src, int src_step,
+    int width, int height, uint8_t* dst, int dst_step)
+{
+  GrayToBgrKernel kernel = kernels().gray_to_bgr;
+  for (int v = 0; v < height; ++v)
+  {
+    kernel(src + v * src_step, width, dst + v * dst_step);
+  }
+}
+
+const uint8_t* fovis_ros::image_conversion::grayData(const uint8_t* src,
+    int src_step, int width, int height, const std::string& encoding,
+    AlignedBuffer& buffer)
+{
+  namespace enc = sensor_msgs::image_encodings;
+  if (encoding == enc::MONO8 || encoding == enc::TYPE_8UC1)
+  {
+    if (src_step == width) return src;
+    uint8_t* dst = buffer.resize(width * height);
+    packRows(src, src_step, width, height, dst);
+    return dst;
+  }
+
+  if (enc::isBayer(encoding) && enc::bitDepth(encoding) == 8)
+  {
+    if (width < 2 || height < 2) return NULL;
+    BayerToGrayKernel kernel = kernels().bayer_to_gray;
+    uint8_t* dst = buffer.resize(width * height);
+    for (int v = 0; v < height; ++v)
+    {
+      // rows are reflected at the borders, which keeps the pattern
+      const int above = v > 0 ? v - 1 : 1;
+      const int below = v < height - 1 ? v + 1 : height - 2;
+      kernel(src + above * src_step, src + v * src_step,
+          src + below * src_step, width, dst + v * width);
+    }
+    return dst;
+  }
+
+  ToGrayKernel kernel;
+  int first_byte = 0;
+  if (encoding == enc::BGR8)
+  {
+    kernel = kernels().bgr_to_gray;
+  }
+  else if (encoding == enc::RGB8)
+  {
+    kernel = kernels().rgb_to_gray;
+  }
+  else if (encoding == enc::YUV422)
+  {
+    // UYVY
+    kernel = kernels().yuv422_to_gray;
+    first_byte = 1;
+  }
+  else if (encoding == "yuv422_yuy2")
+  {
+    // YUYV, not defined by older versions of sensor_msgs
+    kernel = kernels().yuv422_to_gray;
+  }
+  else
+  {
+    return NULL;
+  }
+  uint8_t* dst = buffer.resize(width * height);
+  for (int v = 0; v < height; ++v)
+  {
+    kernel(src + v * src_step + first_byte, width, dst + v * width);
+  }
+  return dst;
+}
+
+void fovis_ros::image_conversion::createRemapTable(const float* map_x,
+    const float* map_y, int width, int height, int src_width, int src_height,
+    RemapTable& table)
+{
+  table.width = width;
+  table.height = height;
+  table.src_width = src_width;
+  table.src_height = src_height;
+  table.offsets.resize(width * height);
+  table.x_weights.resize(2 * width * height);
+  table.y_weights.resize(2 * width * height);
+  table.wide_loads_safe.assign(height, 1);
+  const int64_t src_size = static_cast<int64_t>(src_width) * src_height;
+  for (int v = 0; v < height; ++v)
+  {
+    for (int u = 0; u < width; ++u)
+    {
+      const int i = v * width + u;
+      const float x = map_x[i];
+      const float y = map_y[i];
+      int x0 = 0, y0 = 0, fx = 0, fy = 0, weight = REMAP_ONE;
+      // also false for NaN
+      if (x >= 0.0f && y >= 0.0f && x <= src_width - 1 && y <= src_height - 1)
+      {
+        x0 = static_cast<int>(x);
+        y0 = static_cast<int>(y);
+        fx = static_cast<int>((x - x0) * REMAP_ONE + 0.5f);
+        fy = static_cast<int>((y - y0) * REMAP_ONE + 0.5f);
+        if (fx == REMAP_ONE) { ++x0; fx = 0; }
+        if (fy == REMAP_ONE) { ++y0; fy = 0; }
+        // keep the neighbourhood inside at the last column and row
+        if (x0 >= src_width - 1) { x0 = src_width - 2; fx = REMAP_ONE; }
+        if (y0 >= src_height - 1) { y0 = src_height - 2; fy = REMAP_ONE; }
+      }
+      else
+      {
+        weight = 0;
+      }
+      table.offsets[i] = y0 * src_width + x0;
+      table.x_weights[2 * i] = (REMAP_ONE - fx) * weight / REMAP_ONE;
+      table.x_weights[2 * i + 1] = fx * weight / REMAP_ONE;
+      table.y_weights[2 * i] = REMAP_ONE - fy;
+      table.y_weights[2 * i + 1] = fy;
+      if (table.offsets[i] + src_width + 4 > src_size)
+      {
+        table.wide_loads_safe[v] = 0;
+      }
+    }
+  }
+}
+
+void fovis_ros::image_conversion::remap(const uint8_t* src,
+    const RemapTable& table, uint8_t* dst)
+{
+  RemapKernel kernel = kernels().remap;
+  for (int v = 0; v < table.height; ++v)
+  {
+    const int i = v * table.width;
+    (table.wide_loads_safe[v] ? kernel : remapRowScalar)(src, table.src_width,
+        &table.offsets[i], &table.x_weights[2 * i], &table.y_weights[2 * i],
+        table.width, dst + i);
+  }
+}
+
+void fovis_ros::image_conversion::packRows(const void* src, int src_step,
+    int row_size, int height, void* dst)
+{
+  // memcpy is already dispatched to the best variant for the CPU by the
+  // C library
+  const uint8_t* src_row = reinterpret_cast<const uint8_t*>(src);
+  uint8_t* dst_row = reinterpret_cast<uint8_t*>(dst);
+  for (int v = 0; v < height; ++v)
+  {
+    std::memcpy(dst_row, src_row, row_size);
+    src_row += src_step;
+    dst_row += row_size;
+  }
+}
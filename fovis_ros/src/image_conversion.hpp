@@ -0,0 +1,172 @@
+#ifndef __FOVIS_ROS_IMAGE_CONVERSION_H__
+#define __FOVIS_ROS_IMAGE_CONVERSION_H__
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace fovis_ros
+{
+
+namespace image_conversion
+{
+  /**
+   * Returns the name of the instruction set ("scalar", "sse2", "avx2"
+   * or "neon") of the conversion kernels, which are chosen at runtime
+   * for the CPU the process runs on.
+   */
+  const char* instructionSet();
+
+  /**
+   * Converts a depth image given in millimetres (16UC1, as published
+   * by OpenNI drivers) to a packed float image in metres. Zero depth
+   * values (no measurement) are mapped to NaN.
+   * \param src first row of the source image
+   * \param src_step row stride of the source image in bytes
+   * \param dst destination buffer of width*height floats
+   */
+  void depthMillimetresToMetres(const uint16_t* src, int src_step,
+      int width, int height, float* dst);
+
+  /**
+   * Converts an 8 bit gray image to BGR by replicating each value into
+   * the three channels.
+   * \param src_step row stride of the source image in bytes
+   * \param dst_step row stride of the destination image in bytes
+   */
+  void grayToBgr(const uint8_t* src, int src_step, int width, int height,
+      uint8_t* dst, int dst_step);
+
+  /**
+   * Byte buffer whose data is aligned for SIMD loads and stores. The
+   * memory only grows, so the buffer can be reused across frames without
+   * allocations.
+   */
+  class AlignedBuffer
+  {
+  public:
+
+    static const size_t ALIGNMENT = 32;
+
+    AlignedBuffer() : size_(0) {}
+
+    /**
+     * Resizes the buffer to size bytes, the contents are not preserved.
+     * \return the data of the buffer
+     */
+    uint8_t* resize(size_t size)
+    {
+      if (storage_.size() < size + ALIGNMENT - 1)
+      {
+        storage_.resize(size + ALIGNMENT - 1);
+      }
+      size_ = size;
+      return data();
+    }
+
+    uint8_t* data()
+    {
+      if (storage_.empty()) return NULL;
+      const uintptr_t address = reinterpret_cast<uintptr_t>(&storage_[0]);
+      return &storage_[0] + (ALIGNMENT - address % ALIGNMENT) % ALIGNMENT;
+    }
+
+    size_t size() const
+    {
+      return size_;
+    }
+
+  private:
+
+    std::vector<uint8_t> storage_;
+    size_t size_;
+  };
+
+  /**
+   * Returns the pixels of an 8 bit image as a packed gray image, as
+   * libfovis expects it. Packed mono8 images are returned as they are,
+   * all other images are converted into buffer in a single pass:
+   * bgr8 and rgb8 to luminance with the weights used by OpenCV, Bayer
+   * images (bayer_*8) by filtering with the 3x3 binomial kernel, which
+   * weights R:G:B 1:2:1 at every pixel without demosaicing, and
+   * yuv422 (UYVY) and yuv422_yuy2 (YUYV) by taking Y.
+   * \param src first row of the image
+   * \param src_step row stride of the image in bytes
+   * \return NULL if the encoding is not supported
+   */
+  const uint8_t* grayData(const uint8_t* src, int src_step, int width,
+      int height, const std::string& encoding, AlignedBuffer& buffer);
+
+  /**
+   * Lookup table for remapping an 8 bit image with bilinear
+   * interpolation in fixed point, created by createRemapTable().
+   */
+  struct RemapTable
+  {
+    // size of the destination and of the (packed) source image
+    int width;
+    int height;
+    int src_width;
+    int src_height;
+    // per destination pixel: index of the top left source pixel, two
+    // horizontal weights (sum 64, both 0 outside of the source image)
+    // and two vertical weights (sum 64)
+    std::vector<int32_t> offsets;
+    std::vector<uint8_t> x_weights;
+    std::vector<int16_t> y_weights;
+    // per destination row: whether 4 byte loads at all source pixels of
+    // the row stay within the source image
+    std::vector<uint8_t> wide_loads_safe;
+  };
+
+  /**
+   * Creates the lookup table for a map given as source coordinates of
+   * each destination pixel.
+   * \param map_x packed width*height source x coordinates
+   * \param map_y packed width*height source y coordinates
+   */
+  void createRemapTable(const float* map_x, const float* map_y,
+      int width, int height, int src_width, int src_height, RemapTable& table);
+
+  /**
+   * Remaps the packed source image src into the packed destination image
+   * dst of table.width*table.height pixels. Pixels mapped outside of the
+   * source are set to 0.
+   */
+  void remap(const uint8_t* src, const RemapTable& table, uint8_t* dst);
+
+  /**
+   * Copies height rows of row_size bytes each from a strided image
+   * into the packed buffer dst.
+   * \param src_step row stride of the source image in bytes
+   */
+  void packRows(const void* src, int src_step, int row_size, int height,
+      void* dst);
+
+  /**
+   * Returns the pixel data of an image as packed rows, as libfovis
+   * expects it. Packed images are returned as they are, images with
+   * padded rows (or ROIs of larger images) are repacked into buffer,
+   * which is reused across calls.
+   * \param src first row of the image
+   * \param src_step row stride of the image in bytes
+   * \param width number of pixels of type T per row
+   */
+  template<typename T>
+  const T* packedData(const uint8_t* src, int src_step, int width, int height,
+      std::vector<T>& buffer)
+  {
+    const int row_size = width * sizeof(T);
+    if (src_step == row_size)
+    {
+      return reinterpret_cast<const T*>(src);
+    }
+    buffer.resize(width * height);
+    packRows(src, src_step, row_size, height, buffer.data());
+    return buffer.data();
+  }
+} // end of namespace image_conversion
+
+} // end of namespace fovis_ros
+
+#endif
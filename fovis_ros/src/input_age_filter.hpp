@@ -0,0 +1,57 @@
+#ifndef INPUT_AGE_FILTER_H_
+#define INPUT_AGE_FILTER_H_
+
+#include <ros/ros.h>
+
+namespace fovis_ros
+{
+
+/**
+ * Latency budget of the processors: rejects input tuples whose stamp is
+ * older than ~max_input_age when they arrive and counts them.
+ */
+class InputAgeFilter
+{
+
+public:
+
+  /**
+   * Reads ~max_input_age from local_nh, 0 disables dropping.
+   */
+  explicit InputAgeFilter(const ros::NodeHandle& local_nh) :
+    dropped_(0)
+  {
+    local_nh.param("max_input_age", max_input_age_, 0.0);
+  }
+
+  /**
+   * \return false if the tuple stamped with stamp has to be dropped
+   */
+  bool accept(const ros::Time& stamp)
+  {
+    if (max_input_age_ <= 0.0) return true;
+    double age = (ros::Time::now() - stamp).toSec();
+    if (age <= max_input_age_) return true;
+    ++dropped_;
+    ROS_DEBUG("Dropping input tuple that is %.3fs old (max_input_age is %.3fs).",
+              age, max_input_age_);
+    return false;
+  }
+
+  /**
+   * Number of tuples rejected since construction.
+   */
+  int numDropped() const
+  {
+    return dropped_;
+  }
+
+private:
+
+  double max_input_age_;
+  int dropped_;
+};
+
+} // end of namespace
+
+#endif
@@ -0,0 +1,20 @@
+
+#include "mono_cloud_odometer.hpp"
+
+int main(int argc, char **argv)
+{
+  ros::init(argc, argv, "mono_cloud_odometer");
+  if (ros::names::remap("camera") == "camera") {
+    ROS_WARN("'camera' has not been remapped! Example command-line usage:\n"
+             "\t$ rosrun fovis_ros mono_cloud_odometer camera:=/camera image:=image_rect points:=/velodyne_points");
+  }
+
+  std::string transport = argc > 1 ? argv[1] : "raw";
+  ros::NodeHandle nh;
+  ros::NodeHandle local_nh("~");
+  fovis_ros::MonoCloudOdometer odometer(nh, local_nh, transport);
+
+  ros::spin();
+  return 0;
+}
+
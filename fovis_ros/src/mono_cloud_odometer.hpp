@@ -0,0 +1,153 @@
+#ifndef MONO_CLOUD_ODOMETER_H_
+#define MONO_CLOUD_ODOMETER_H_
+
+#include <ros/ros.h>
+#include <image_geometry/pinhole_camera_model.h>
+#include <pcl_conversions/pcl_conversions.h>
+
+#include <fovis_ros/FovisInfo.h>
+
+#include "mono_cloud_processor.hpp"
+#include "point_cloud_depth_source.hpp"
+#include "odometer_base.hpp"
+
+namespace fovis_ros
+{
+
+/**
+ * Mono odometer that takes the depth of the keypoints from a point
+ * cloud (e.g. of a LiDAR) that is projected into the camera image.
+ */
+class MonoCloudOdometer : public MonoCloudProcessor, OdometerBase
+{
+
+private:
+
+  PointCloudDepthSource* cloud_depth_;
+  int search_radius_;
+  // how long to wait for the tf of a cloud
+  double transform_timeout_;
+
+  struct MonoCloudFrame : public Frame
+  {
+    // converted input cloud, kept to reuse its memory
+    pcl::PointCloud<pcl::PointXYZ> cloud;
+    ProjectedCloud projected;
+  };
+
+public:
+
+  MonoCloudOdometer(const ros::NodeHandle& nh, const ros::NodeHandle& local_nh,
+      const std::string& transport) :
+    MonoCloudProcessor(nh, local_nh, transport),
+    OdometerBase(local_nh),
+    cloud_depth_(NULL)
+  {
+    local_nh.param("cloud_search_radius", search_radius_, 2);
+    local_nh.param("cloud_transform_timeout", transform_timeout_, 0.05);
+    subscribe();
+  }
+
+  ~MonoCloudOdometer()
+  {
+    unsubscribe();
+    stopPipeline();
+    if (cloud_depth_) delete cloud_depth_;
+  }
+
+protected:
+
+  PointCloudDepthSource* createDepthSource(
+      const sensor_msgs::CameraInfoConstPtr& info_msg) const
+  {
+    // read calibration info from camera info message
+    image_geometry::PinholeCameraModel model;
+    model.fromCameraInfo(*info_msg);
+
+    fovis::CameraIntrinsicsParameters parameters;
+    rosToFovis(model, parameters);
+
+    return new PointCloudDepthSource(parameters, search_radius_);
+  }
+
+  /**
+   * Looks up the transform from the cloud frame to the camera frame,
+   * waiting up to ~cloud_transform_timeout for it to arrive.
+   * \return false if it is not available
+   */
+  bool getCloudToCameraTransform(const std_msgs::Header& image_header,
+      const std_msgs::Header& cloud_header, Eigen::Affine3f& cloud_to_camera)
+  {
+    tf::TransformListener& tf_listener = getTransformListener();
+    std::string error_msg;
+    if (!tf_listener.waitForTransform(image_header.frame_id,
+          cloud_header.frame_id, cloud_header.stamp,
+          ros::Duration(transform_timeout_), ros::Duration(0.005), &error_msg))
+    {
+      ROS_WARN_THROTTLE(10.0, "The tf from '%s' to '%s' does not seem to be "
+                              "available, dropping input!",
+                              image_header.frame_id.c_str(),
+                              cloud_header.frame_id.c_str());
+      ROS_DEBUG("Transform error: %s", error_msg.c_str());
+      return false;
+    }
+    tf::StampedTransform transform;
+    tf_listener.lookupTransform(image_header.frame_id,
+        cloud_header.frame_id, cloud_header.stamp, transform);
+
+    const tf::Matrix3x3& basis = transform.getBasis();
+    const tf::Vector3& origin = transform.getOrigin();
+    cloud_to_camera.setIdentity();
+    for (int i = 0; i < 3; ++i)
+    {
+      for (int j = 0; j < 3; ++j)
+        cloud_to_camera.matrix()(i, j) = basis[i][j];
+      cloud_to_camera.matrix()(i, 3) = origin[i];
+    }
+    return true;
+  }
+
+  void imageCallback(
+      const sensor_msgs::ImageConstPtr& image_msg,
+      const sensor_msgs::CameraInfoConstPtr& info_msg,
+      const sensor_msgs::PointCloud2ConstPtr& cloud_msg)
+  {
+    Eigen::Affine3f cloud_to_camera;
+    if (!getCloudToCameraTransform(image_msg->header, cloud_msg->header,
+          cloud_to_camera))
+      return;
+
+    if (!cloud_depth_)
+    {
+      cloud_depth_ = createDepthSource(info_msg);
+      setDepthSource(cloud_depth_);
+    }
+
+    MonoCloudFrame* frame = static_cast<MonoCloudFrame*>(acquireFrame());
+    if (!frame) return;
+    frame->num_dropped_inputs = getNumDroppedInputs();
+
+    pcl::fromROSMsg(*cloud_msg, frame->cloud);
+    frame->projected.project(frame->cloud, cloud_to_camera,
+        cloud_depth_->getParameters());
+
+    // call base implementation
+    process(frame, image_msg, info_msg);
+  }
+
+  Frame* createFrame() const
+  {
+    return new MonoCloudFrame();
+  }
+
+  void updateDepthSource(const Frame& frame)
+  {
+    // pass projected points to depth source
+    cloud_depth_->setProjectedCloud(
+        &static_cast<const MonoCloudFrame&>(frame).projected);
+  }
+};
+
+} // end of namespace
+
+#endif
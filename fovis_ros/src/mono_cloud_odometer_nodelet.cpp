@@ -0,0 +1,34 @@
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
+#include <boost/scoped_ptr.hpp>
+
+#include "mono_cloud_odometer.hpp"
+
+namespace fovis_ros
+{
+
+/**
+ * Nodelet version of the mono cloud odometer. Running it in the same
+ * manager as the camera and point cloud drivers avoids serialization
+ * and copies of the incoming messages.
+ */
+class MonoCloudOdometerNodelet : public nodelet::Nodelet
+{
+
+private:
+
+  boost::scoped_ptr<MonoCloudOdometer> odometer_;
+
+  virtual void onInit()
+  {
+    std::string transport;
+    getPrivateNodeHandle().param("transport", transport, std::string("raw"));
+    odometer_.reset(new MonoCloudOdometer(
+          getNodeHandle(), getPrivateNodeHandle(), transport));
+  }
+};
+
+} // end of namespace
+
+PLUGINLIB_EXPORT_CLASS(fovis_ros::MonoCloudOdometerNodelet, nodelet::Nodelet)
+
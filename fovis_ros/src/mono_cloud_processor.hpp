@@ -0,0 +1,203 @@
+#ifndef MONO_CLOUD_PROCESSOR_H_
+#define MONO_CLOUD_PROCESSOR_H_
+
+#include <ros/ros.h>
+#include <sensor_msgs/Image.h>
+#include <sensor_msgs/CameraInfo.h>
+#include <sensor_msgs/PointCloud2.h>
+
+#include <message_filters/subscriber.h>
+#include <message_filters/synchronizer.h>
+#include <message_filters/sync_policies/exact_time.h>
+#include <message_filters/sync_policies/approximate_time.h>
+#include <image_transport/subscriber_filter.h>
+
+#include "input_age_filter.hpp"
+
+namespace fovis_ros
+{
+
+/**
+ * This is an abstract base class for nodes that process a mono camera
+ * image together with a point cloud, e.g. of a LiDAR.
+ * It handles synchronization of input topics (approximate or exact)
+ * and checks for sync errors.
+ * To use this class, subclass it and implement the imageCallback() method.
+ */
+class MonoCloudProcessor
+{
+
+private:
+
+  ros::NodeHandle nh_;
+  ros::NodeHandle local_nh_;
+  std::string transport_;
+
+  // subscriber
+  image_transport::SubscriberFilter image_sub_;
+  message_filters::Subscriber<sensor_msgs::CameraInfo> info_sub_;
+  message_filters::Subscriber<sensor_msgs::PointCloud2> cloud_sub_;
+  typedef message_filters::sync_policies::ExactTime<sensor_msgs::Image, sensor_msgs::CameraInfo, sensor_msgs::PointCloud2> ExactPolicy;
+  typedef message_filters::sync_policies::ApproximateTime<sensor_msgs::Image, sensor_msgs::CameraInfo, sensor_msgs::PointCloud2> ApproximatePolicy;
+  typedef message_filters::Synchronizer<ExactPolicy> ExactSync;
+  typedef message_filters::Synchronizer<ApproximatePolicy> ApproximateSync;
+  boost::shared_ptr<ExactSync> exact_sync_;
+  boost::shared_ptr<ApproximateSync> approximate_sync_;
+  int queue_size_;
+  bool approximate_sync_enabled_;
+
+  // latency budget, older tuples are dropped
+  InputAgeFilter input_age_filter_;
+
+  // for sync checking
+  ros::WallTimer check_synced_timer_;
+  int image_received_, info_received_, cloud_received_, all_received_;
+
+  // for sync checking
+  static void increment(int* value)
+  {
+    ++(*value);
+  }
+
+  void dataCb(const sensor_msgs::ImageConstPtr& image_msg,
+              const sensor_msgs::CameraInfoConstPtr& info_msg,
+              const sensor_msgs::PointCloud2ConstPtr& cloud_msg)
+  {
+ 
+    // For sync error checking
+    ++all_received_; 
+
+    // drop tuples that cannot be processed within the latency budget
+    if (!input_age_filter_.accept(image_msg->header.stamp)) return;
+
+    // call implementation
+    imageCallback(image_msg, info_msg, cloud_msg);
+  }
+
+  void checkInputsSynchronized()
+  {
+    int threshold = 3 * all_received_;
+    if (image_received_ >= threshold || info_received_ >= threshold || 
+        cloud_received_ >= threshold) {
+      ROS_WARN("[mono_cloud_processor] Low number of synchronized image/info/cloud tuples received.\n"
+               "Images received:            %d (topic '%s')\n"
+               "Camera info received:       %d (topic '%s')\n"
+               "Point clouds received:      %d (topic '%s')\n"
+               "Synchronized tuples: %d\n"
+               "Possible issues:\n"
+               "\t* The camera or the point cloud source is not running.\n"
+               "\t  Does `rosnode info %s` show any connections?\n"
+               "\t* Camera and point cloud source are not synchronized.\n"
+               "\t  Try restarting the node with parameter _approximate_sync:=True\n"
+               "\t* The network is too slow. One or more messages are dropped from each tuple.\n"
+               "\t  Try restarting the node, increasing parameter 'queue_size' (currently %d)",
+               image_received_, image_sub_.getTopic().c_str(),
+               info_received_, info_sub_.getTopic().c_str(),
+               cloud_received_, cloud_sub_.getTopic().c_str(),
+               all_received_, ros::this_node::getName().c_str(), queue_size_);
+    }
+  }
+
+
+protected:
+
+  /**
+   * Constructor, reads parameters. Input topics are not subscribed before
+   * subscribe() is called, which has to be done by the implementing class
+   * once it is fully constructed.
+   * \param nh Node handle used to resolve and subscribe to input topics
+   * \param local_nh Private node handle used to read parameters
+   * \param transport The image transport to use
+   */
+  MonoCloudProcessor(const ros::NodeHandle& nh, const ros::NodeHandle& local_nh,
+      const std::string& transport) :
+    nh_(nh), local_nh_(local_nh), transport_(transport), input_age_filter_(local_nh),
+    image_received_(0), info_received_(0), cloud_received_(0), all_received_(0)
+  {
+    // Read local parameters
+    local_nh_.param("queue_size", queue_size_, 5);
+    local_nh_.param("approximate_sync", approximate_sync_enabled_, true);
+  }
+
+  /**
+   * Subscribes to input topics and registers callbacks. Callbacks may be
+   * called as soon as this method returns (e.g. from a nodelet manager's
+   * worker threads).
+   */
+  void subscribe()
+  {
+    // Resolve topic names
+    std::string camera_ns = nh_.resolveName("camera");
+    std::string image_topic = ros::names::clean(camera_ns + "/" + nh_.resolveName("image"));
+    std::string info_topic = camera_ns + "/camera_info";
+    std::string cloud_topic = nh_.resolveName("points");
+
+    // Subscribe to three input topics.
+    ROS_INFO("Subscribing to:\n\t* %s\n\t* %s\n\t* %s", 
+        image_topic.c_str(), info_topic.c_str(), cloud_topic.c_str());
+
+    image_transport::ImageTransport it(nh_);
+    image_sub_.subscribe(it, image_topic, 1, transport_);
+    info_sub_.subscribe(nh_, info_topic, 1);
+    cloud_sub_.subscribe(nh_, cloud_topic, 1);
+
+    // Complain every 15s if the topics appear unsynchronized
+    image_sub_.registerCallback(boost::bind(MonoCloudProcessor::increment, &image_received_));
+    info_sub_.registerCallback(boost::bind(MonoCloudProcessor::increment, &info_received_));
+    cloud_sub_.registerCallback(boost::bind(MonoCloudProcessor::increment, &cloud_received_));
+    check_synced_timer_ = nh_.createWallTimer(ros::WallDuration(15.0),
+                                              boost::bind(&MonoCloudProcessor::checkInputsSynchronized, this));
+
+    // Synchronize input topics. Optionally do approximate synchronization.
+    if (approximate_sync_enabled_)
+    {
+      approximate_sync_.reset(new ApproximateSync(ApproximatePolicy(queue_size_),
+                                                  image_sub_, info_sub_, cloud_sub_) );
+      approximate_sync_->registerCallback(boost::bind(&MonoCloudProcessor::dataCb, this, _1, _2, _3));
+    }
+    else
+    {
+      exact_sync_.reset(new ExactSync(ExactPolicy(queue_size_),
+                                      image_sub_, info_sub_, cloud_sub_) );
+      exact_sync_->registerCallback(boost::bind(&MonoCloudProcessor::dataCb, this, _1, _2, _3));
+    }
+  }
+
+  /**
+   * Shuts down the subscriptions, once this returns no callback is
+   * running or will be called. Implementing classes have to call this
+   * first thing in their destructor, as the processor is destroyed
+   * after them.
+   */
+  void unsubscribe()
+  {
+    check_synced_timer_.stop();
+    image_sub_.unsubscribe();
+    info_sub_.unsubscribe();
+    cloud_sub_.unsubscribe();
+    exact_sync_.reset();
+    approximate_sync_.reset();
+  }
+
+  /**
+   * Returns the number of synchronized input tuples that have been
+   * dropped because they were older than ~max_input_age.
+   */
+  int getNumDroppedInputs() const
+  {
+    return input_age_filter_.numDropped();
+  }
+
+  /**
+   * Implement this method in sub-classes 
+   */
+  virtual void imageCallback(const sensor_msgs::ImageConstPtr& image_msg,
+                             const sensor_msgs::CameraInfoConstPtr& info_msg,
+                             const sensor_msgs::PointCloud2ConstPtr& cloud_msg) = 0;
+
+};
+
+} // end of namespace
+
+#endif
+
@@ -0,0 +1,160 @@
+#ifndef MONO_DEPTH_ODOMETER_H_
+#define MONO_DEPTH_ODOMETER_H_
+
+#include <ros/ros.h>
+#include <sensor_msgs/image_encodings.h>
+#include <image_geometry/stereo_camera_model.h>
+#include <cv_bridge/cv_bridge.h>
+
+#include <fovis_ros/FovisInfo.h>
+
+#include <libfovis/depth_image.hpp>
+
+#include "mono_depth_processor.hpp"
+#include "odometer_base.hpp"
+#include "visualization.hpp"
+#include "image_conversion.hpp"
+
+namespace fovis_ros
+{
+
+class MonoDepthOdometer : public MonoDepthProcessor, OdometerBase
+{
+
+private:
+
+  fovis::DepthImage* depth_image_;
+
+  struct MonoDepthFrame : public Frame
+  {
+    // keeps the depth image alive if it is used without a copy
+    sensor_msgs::ImageConstPtr depth_msg;
+    const float* depth_data;
+    // packed metric depth, used if the input is not given in metres
+    // or has padded rows
+    std::vector<float> depth_buffer;
+  };
+
+public:
+
+  /**
+   * \param tf_listener see OdometerBase
+   * \param pool see OdometerBase
+   */
+  MonoDepthOdometer(const ros::NodeHandle& nh, const ros::NodeHandle& local_nh,
+      const std::string& transport,
+      const boost::shared_ptr<tf::TransformListener>& tf_listener =
+        boost::shared_ptr<tf::TransformListener>(),
+      WorkStealingPool* pool = NULL) : 
+    MonoDepthProcessor(nh, local_nh, transport),
+    OdometerBase(local_nh, tf_listener, pool),
+    depth_image_(NULL)
+  {
+    subscribe();
+  }
+
+  ~MonoDepthOdometer()
+  {
+    unsubscribe();
+    stopPipeline();
+    if (depth_image_) delete depth_image_;
+  }
+
+  /**
+   * Creates the depth source for a camera with registered depth image.
+   * Does not need a connection to a ROS master.
+   */
+  static fovis::DepthImage* createDepthSource(
+      const sensor_msgs::CameraInfoConstPtr& image_info_msg,
+      const sensor_msgs::CameraInfoConstPtr& depth_info_msg)
+  {
+    // read calibration info from camera info message
+    image_geometry::PinholeCameraModel model;
+    model.fromCameraInfo(*image_info_msg);
+    
+    // initialize left camera parameters
+    fovis::CameraIntrinsicsParameters parameters;
+    rosToFovis(model, parameters);
+
+    return new fovis::DepthImage(parameters, 
+        depth_info_msg->width, depth_info_msg->height);
+  }
+
+  /**
+   * Returns the depth of depth_msg as packed floats in metres, as
+   * fovis::DepthImage expects it. buffer is used for converted or
+   * repacked data and reused across calls.
+   * \return NULL if the encoding is neither 32FC1 nor 16UC1
+   */
+  static const float* metricDepthData(const sensor_msgs::Image& depth_msg,
+      std::vector<float>& buffer)
+  {
+    if (depth_msg.encoding == sensor_msgs::image_encodings::TYPE_32FC1)
+    {
+      // libfovis needs packed rows, repack padded images
+      return image_conversion::packedData(
+          depth_msg.data.data(), depth_msg.step,
+          depth_msg.width, depth_msg.height, buffer);
+    }
+    else if (depth_msg.encoding == sensor_msgs::image_encodings::TYPE_16UC1)
+    {
+      // depth in millimetres, convert to metres
+      buffer.resize(depth_msg.width * depth_msg.height);
+      image_conversion::depthMillimetresToMetres(
+          reinterpret_cast<const uint16_t*>(depth_msg.data.data()),
+          depth_msg.step, depth_msg.width, depth_msg.height,
+          buffer.data());
+      return buffer.data();
+    }
+    return NULL;
+  }
+
+protected:
+
+  void imageCallback(
+      const sensor_msgs::ImageConstPtr& image_msg,
+      const sensor_msgs::ImageConstPtr& depth_msg,
+      const sensor_msgs::CameraInfoConstPtr& image_info_msg,
+      const sensor_msgs::CameraInfoConstPtr& depth_info_msg)
+  {
+    if (!depth_image_)
+    {
+      depth_image_ = createDepthSource(image_info_msg, depth_info_msg);
+      setDepthSource(depth_image_);
+    }
+
+    if (depth_msg->encoding != sensor_msgs::image_encodings::TYPE_32FC1 &&
+        depth_msg->encoding != sensor_msgs::image_encodings::TYPE_16UC1)
+    {
+      ROS_ERROR("Depth image must be in 32bit floating point format (metres) "
+                "or 16bit unsigned integer format (millimetres)!");
+      return;
+    }
+
+    MonoDepthFrame* frame = static_cast<MonoDepthFrame*>(acquireFrame());
+    if (!frame) return;
+    frame->num_dropped_inputs = getNumDroppedInputs();
+
+    frame->depth_msg = depth_msg;
+    frame->depth_data = metricDepthData(*depth_msg, frame->depth_buffer);
+
+    // call base implementation
+    process(frame, image_msg, image_info_msg);
+  }
+
+  Frame* createFrame() const
+  {
+    return new MonoDepthFrame();
+  }
+
+  void updateDepthSource(const Frame& frame)
+  {
+    // pass data to depth source
+    depth_image_->setDepthImage(
+        static_cast<const MonoDepthFrame&>(frame).depth_data);
+  }
+};
+
+} // end of namespace
+
+#endif
@@ -0,0 +1,34 @@
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
+#include <boost/scoped_ptr.hpp>
+
+#include "mono_depth_odometer.hpp"
+
+namespace fovis_ros
+{
+
+/**
+ * Nodelet version of the mono depth odometer. Running it in the same
+ * manager as the camera driver avoids serialization and copies of
+ * the incoming images.
+ */
+class MonoDepthOdometerNodelet : public nodelet::Nodelet
+{
+
+private:
+
+  boost::scoped_ptr<MonoDepthOdometer> odometer_;
+
+  virtual void onInit()
+  {
+    std::string transport;
+    getPrivateNodeHandle().param("transport", transport, std::string("raw"));
+    odometer_.reset(new MonoDepthOdometer(
+          getNodeHandle(), getPrivateNodeHandle(), transport));
+  }
+};
+
+} // end of namespace
+
+PLUGINLIB_EXPORT_CLASS(fovis_ros::MonoDepthOdometerNodelet, nodelet::Nodelet)
+
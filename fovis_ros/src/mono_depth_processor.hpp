@@ -1,5 +1,5 @@
-#ifndef STEREO_PROCESSOR_H_
-#define STEREO_PROCESSOR_H_
+#ifndef MONO_DEPTH_PROCESSOR_H_
+#define MONO_DEPTH_PROCESSOR_H_
 
 #include <ros/ros.h>
 #include <sensor_msgs/Image.h>
@@ -11,6 +11,8 @@
 #include <message_filters/sync_policies/approximate_time.h>
 #include <image_transport/subscriber_filter.h>
 
+#include "input_age_filter.hpp"
+
 namespace fovis_ros
 {
 
@@ -26,6 +28,10 @@ class MonoDepthProcessor
 
 private:
 
+  ros::NodeHandle nh_;
+  ros::NodeHandle local_nh_;
+  std::string transport_;
+
   // subscriber
   image_transport::SubscriberFilter image_sub_, depth_sub_;
   message_filters::Subscriber<sensor_msgs::CameraInfo> image_info_sub_, depth_info_sub_;
@@ -36,6 +42,10 @@ private:
   boost::shared_ptr<ExactSync> exact_sync_;
   boost::shared_ptr<ApproximateSync> approximate_sync_;
   int queue_size_;
+  bool approximate_sync_enabled_;
+
+  // latency budget, older tuples are dropped
+  InputAgeFilter input_age_filter_;
 
   // for sync checking
   ros::WallTimer check_synced_timer_;
@@ -56,6 +66,9 @@ private:
     // For sync error checking
     ++all_received_; 
 
+    // drop tuples that cannot be processed within the latency budget
+    if (!input_age_filter_.accept(image_msg->header.stamp)) return;
+
     // call implementation
     imageCallback(image_msg, depth_image_msg, image_info_msg, depth_info_msg);
   }
@@ -83,19 +96,32 @@ private:
 protected:
 
   /**
-   * Constructor, subscribes to input topics using image transport and registers
-   * callbacks.
+   * Constructor, reads parameters. Input topics are not subscribed before
+   * subscribe() is called, which has to be done by the implementing class
+   * once it is fully constructed.
+   * \param nh Node handle used to resolve and subscribe to input topics
+   * \param local_nh Private node handle used to read parameters
    * \param transport The image transport to use
    */
-  MonoDepthProcessor(const std::string& transport) :
+  MonoDepthProcessor(const ros::NodeHandle& nh, const ros::NodeHandle& local_nh,
+      const std::string& transport) :
+    nh_(nh), local_nh_(local_nh), transport_(transport), input_age_filter_(local_nh),
     image_received_(0), depth_received_(0), image_info_received_(0), depth_info_received_(0), all_received_(0)
   {
     // Read local parameters
-    ros::NodeHandle local_nh("~");
+    local_nh_.param("queue_size", queue_size_, 5);
+    local_nh_.param("approximate_sync", approximate_sync_enabled_, true);
+  }
 
+  /**
+   * Subscribes to input topics using image transport and registers
+   * callbacks. Callbacks may be called as soon as this method returns
+   * (e.g. from a nodelet manager's worker threads).
+   */
+  void subscribe()
+  {
     // Resolve topic names
-    ros::NodeHandle nh;
-    std::string camera_ns = nh.resolveName("camera");
+    std::string camera_ns = nh_.resolveName("camera");
     std::string image_topic = ros::names::clean(camera_ns + "/rgb/image_rect");
     std::string depth_topic = ros::names::clean(camera_ns + "/depth_registered/image_rect");
 
@@ -107,25 +133,22 @@ protected:
         image_topic.c_str(), depth_topic.c_str(),
         image_info_topic.c_str(), depth_info_topic.c_str());
 
-    image_transport::ImageTransport it(nh);
-    image_sub_.subscribe(it, image_topic, 1, transport);
-    depth_sub_.subscribe(it, depth_topic, 1, transport);
-    image_info_sub_.subscribe(nh, image_info_topic, 1);
-    depth_info_sub_.subscribe(nh, depth_info_topic, 1);
+    image_transport::ImageTransport it(nh_);
+    image_sub_.subscribe(it, image_topic, 1, transport_);
+    depth_sub_.subscribe(it, depth_topic, 1, transport_);
+    image_info_sub_.subscribe(nh_, image_info_topic, 1);
+    depth_info_sub_.subscribe(nh_, depth_info_topic, 1);
 
     // Complain every 15s if the topics appear unsynchronized
     image_sub_.registerCallback(boost::bind(MonoDepthProcessor::increment, &image_received_));
     depth_sub_.registerCallback(boost::bind(MonoDepthProcessor::increment, &depth_received_));
     image_info_sub_.registerCallback(boost::bind(MonoDepthProcessor::increment, &image_info_received_));
     depth_info_sub_.registerCallback(boost::bind(MonoDepthProcessor::increment, &depth_info_received_));
-    check_synced_timer_ = nh.createWallTimer(ros::WallDuration(15.0),
-                                             boost::bind(&MonoDepthProcessor::checkInputsSynchronized, this));
+    check_synced_timer_ = nh_.createWallTimer(ros::WallDuration(15.0),
+                                              boost::bind(&MonoDepthProcessor::checkInputsSynchronized, this));
 
     // Synchronize input topics. Optionally do approximate synchronization.
-    local_nh.param("queue_size", queue_size_, 5);
-    bool approx;
-    local_nh.param("approximate_sync", approx, true);
-    if (approx)
+    if (approximate_sync_enabled_)
     {
       approximate_sync_.reset(new ApproximateSync(ApproximatePolicy(queue_size_),
                                                   image_sub_, depth_sub_, image_info_sub_, depth_info_sub_) );
@@ -139,6 +162,32 @@ protected:
     }
   }
 
+  /**
+   * Shuts down the subscriptions, once this returns no callback is
+   * running or will be called. Implementing classes have to call this
+   * first thing in their destructor, as the processor is destroyed
+   * after them.
+   */
+  void unsubscribe()
+  {
+    check_synced_timer_.stop();
+    image_sub_.unsubscribe();
+    depth_sub_.unsubscribe();
+    image_info_sub_.unsubscribe();
+    depth_info_sub_.unsubscribe();
+    exact_sync_.reset();
+    approximate_sync_.reset();
+  }
+
+  /**
+   * Returns the number of synchronized input tuples that have been
+   * dropped because they were older than ~max_input_age.
+   */
+  int getNumDroppedInputs() const
+  {
+    return input_age_filter_.numDropped();
+  }
+
   /**
    * Implement this method in sub-classes 
    */
@@ -0,0 +1,103 @@
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/thread.hpp>
+
+#include "stereo_odometer.hpp"
+#include "mono_depth_odometer.hpp"
+#include "work_stealing_pool.hpp"
+
+namespace
+{
+
+bool getString(XmlRpc::XmlRpcValue& rig, const std::string& key,
+    std::string& value)
+{
+  if (!rig.hasMember(key) ||
+      rig[key].getType() != XmlRpc::XmlRpcValue::TypeString)
+    return false;
+  value = static_cast<std::string&>(rig[key]);
+  return true;
+}
+
+} // end of anonymous namespace
+
+/**
+ * Hosts one odometer per camera rig in a single process. All odometers
+ * share one tf listener and one thread pool, frames of one rig are
+ * processed in order while different rigs run concurrently.
+ */
+int main(int argc, char **argv)
+{
+  ros::init(argc, argv, "multi_odometer");
+  ros::NodeHandle local_nh("~");
+
+  XmlRpc::XmlRpcValue rigs;
+  if (!local_nh.getParam("rigs", rigs) ||
+      rigs.getType() != XmlRpc::XmlRpcValue::TypeArray || rigs.size() == 0)
+  {
+    ROS_FATAL("~rigs has to be a list of rigs, e.g.\n"
+              "\trigs: [{name: front, type: stereo, namespace: /front_stereo},\n"
+              "\t       {name: kinect, type: mono_depth, namespace: /camera}]");
+    return 1;
+  }
+  int num_threads;
+  local_nh.param("num_threads", num_threads,
+      static_cast<int>(boost::thread::hardware_concurrency()));
+  std::string transport;
+  local_nh.param("transport", transport, std::string("raw"));
+
+  // the pool has to outlive the odometers, which wait for their tasks
+  // on destruction
+  fovis_ros::WorkStealingPool pool(num_threads);
+  boost::shared_ptr<tf::TransformListener> tf_listener(
+      new tf::TransformListener());
+  std::vector<boost::shared_ptr<fovis_ros::StereoOdometer> > stereo_odometers;
+  std::vector<boost::shared_ptr<fovis_ros::MonoDepthOdometer> > mono_depth_odometers;
+
+  for (int i = 0; i < rigs.size(); ++i)
+  {
+    std::string name, type, ns;
+    if (!getString(rigs[i], "name", name) ||
+        !getString(rigs[i], "type", type) ||
+        !getString(rigs[i], "namespace", ns))
+    {
+      ROS_FATAL("Rig %d needs the string entries name, type and namespace.", i);
+      return 1;
+    }
+    // parameters and outputs of the rig are in ~<name>, its input topics
+    // are resolved as for the single rig nodes with remapped namespace
+    ros::NodeHandle rig_local_nh(local_nh, name);
+    ros::M_string remappings;
+    if (type == "stereo")
+    {
+      std::string image = "image_rect";
+      getString(rigs[i], "image", image);
+      remappings["stereo"] = ns;
+      remappings["image"] = image;
+      ros::NodeHandle rig_nh("", remappings);
+      stereo_odometers.push_back(boost::shared_ptr<fovis_ros::StereoOdometer>(
+            new fovis_ros::StereoOdometer(rig_nh, rig_local_nh, transport,
+              tf_listener, &pool)));
+    }
+    else if (type == "mono_depth")
+    {
+      remappings["camera"] = ns;
+      ros::NodeHandle rig_nh("", remappings);
+      mono_depth_odometers.push_back(boost::shared_ptr<fovis_ros::MonoDepthOdometer>(
+            new fovis_ros::MonoDepthOdometer(rig_nh, rig_local_nh, transport,
+              tf_listener, &pool)));
+    }
+    else
+    {
+      ROS_FATAL("Unknown type '%s' of rig '%s', has to be stereo or mono_depth.",
+          type.c_str(), name.c_str());
+      return 1;
+    }
+  }
+  ROS_INFO("Hosting %d rigs on %d threads.", rigs.size(), pool.size());
+
+  ros::spin();
+  return 0;
+}
+
@@ -1,11 +1,24 @@
+#ifndef ODOMETER_BASE_H_
+#define ODOMETER_BASE_H_
+
 #include <ros/ros.h>
 #include <sensor_msgs/image_encodings.h>
 #include <image_geometry/pinhole_camera_model.h>
 #include <cv_bridge/cv_bridge.h>
+#include <opencv2/imgproc/imgproc.hpp>
 #include <nav_msgs/Odometry.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <sensor_msgs/Imu.h>
 #include <geometry_msgs/PoseStamped.h>
+#include <tf2_msgs/TFMessage.h>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include <pcl_conversions/pcl_conversions.h>
 
 #include <fovis_ros/FovisInfo.h>
+#include <fovis_ros/FovisFeatures.h>
+#include <fovis_ros/SetOptions.h>
+#include <std_srvs/Empty.h>
 
 #include <libfovis/visual_odometry.hpp>
 #include <libfovis/stereo_depth.hpp>
@@ -13,7 +26,25 @@
 #include <tf/transform_listener.h>
 #include <tf/transform_broadcaster.h>
 
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <deque>
+#include <sstream>
+
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+
 #include "visualization.hpp"
+#include "feature_image_worker.hpp"
+#include "image_conversion.hpp"
+#include "spsc_queue.hpp"
+#include "gyro_integrator.hpp"
+#include "work_stealing_pool.hpp"
 
 namespace fovis_ros
 {
@@ -21,43 +52,446 @@ namespace fovis_ros
 /**
  * Base class for fovis odometers.
  */
+class OdometerBase
+{
+
+public:
 
-  float random_sign(){
-    return (((float)(rand()%2))-0.5)*2.0;
+  static void rosToFovis(const image_geometry::PinholeCameraModel& camera_model,
+      fovis::CameraIntrinsicsParameters& parameters)
+  {
+    parameters.cx = camera_model.cx();
+    parameters.cy = camera_model.cy();
+    parameters.fx = camera_model.fx();
+    parameters.fy = camera_model.fy();
+    parameters.width = camera_model.reducedResolution().width;
+    parameters.height = camera_model.reducedResolution().height;
   }
 
+  /**
+   * Creates a visual odometry for the rectified camera described by
+   * info_msg. Does not need a connection to a ROS master.
+   * \param rectification set to the camera model of the odometer, which
+   *        only references it: the caller has to delete it after the
+   *        odometer
+   */
+  static fovis::VisualOdometry* createVisualOdometry(
+      const sensor_msgs::CameraInfoConstPtr& info_msg,
+      const fovis::VisualOdometryOptions& options,
+      fovis::Rectification*& rectification)
+  {
+    image_geometry::PinholeCameraModel model;
+    model.fromCameraInfo(info_msg);
+    fovis::CameraIntrinsicsParameters cam_params;
+    rosToFovis(model, cam_params);
+    rectification = new fovis::Rectification(cam_params);
+    return new fovis::VisualOdometry(rectification, options);
+  }
 
-class OdometerBase
-{
+  /**
+   * Creates the lookup table that rectifies raw images of the camera
+   * described by info_msg, i.e. undistorts them and maps them to the
+   * camera given by the projection matrix. Binning and ROI are not
+   * supported. Does not need a connection to a ROS master.
+   */
+  static void createRectificationTable(const sensor_msgs::CameraInfo& info_msg,
+      image_conversion::RemapTable& table)
+  {
+    cv::Mat intrinsics(3, 3, CV_64F, const_cast<double*>(&info_msg.K[0]));
+    cv::Mat distortion;
+    if (!info_msg.D.empty())
+    {
+      distortion = cv::Mat(1, info_msg.D.size(), CV_64F,
+          const_cast<double*>(&info_msg.D[0]));
+    }
+    cv::Mat rotation(3, 3, CV_64F, const_cast<double*>(&info_msg.R[0]));
+    cv::Mat projection(3, 4, CV_64F, const_cast<double*>(&info_msg.P[0]));
+    cv::Mat map_x, map_y;
+    cv::initUndistortRectifyMap(intrinsics, distortion, rotation,
+        cv::Mat(projection, cv::Rect(0, 0, 3, 3)),
+        cv::Size(info_msg.width, info_msg.height), CV_32FC1, map_x, map_y);
+    image_conversion::createRemapTable(
+        reinterpret_cast<const float*>(map_x.data),
+        reinterpret_cast<const float*>(map_y.data),
+        info_msg.width, info_msg.height, info_msg.width, info_msg.height, table);
+  }
+
+  /**
+   * Fills the statistics of the last processed frame into
+   * fovis_info_msg. Header, timing and dropped inputs are left untouched.
+   */
+  static void fillInfo(const fovis::VisualOdometry* visual_odometer,
+      FovisInfo& fovis_info_msg)
+  {
+    fovis_info_msg.change_reference_frame = 
+      visual_odometer->getChangeReferenceFrames();
+    fovis_info_msg.fast_threshold =
+      visual_odometer->getFastThreshold();
+    const fovis::OdometryFrame* target_frame = 
+      visual_odometer->getTargetFrame();
+    fovis_info_msg.num_total_detected_keypoints =
+      target_frame->getNumDetectedKeypoints();
+    fovis_info_msg.num_total_keypoints = target_frame->getNumKeypoints();
+    fovis_info_msg.num_detected_keypoints.resize(target_frame->getNumLevels());
+    fovis_info_msg.num_keypoints.resize(target_frame->getNumLevels());
+    for (int i = 0; i < target_frame->getNumLevels(); ++i)
+    {
+      fovis_info_msg.num_detected_keypoints[i] =
+        target_frame->getLevel(i)->getNumDetectedKeypoints();
+      fovis_info_msg.num_keypoints[i] =
+        target_frame->getLevel(i)->getNumKeypoints();
+    }
+    const fovis::MotionEstimator* estimator = 
+      visual_odometer->getMotionEstimator();
+    fovis_info_msg.motion_estimate_status_code =
+      estimator->getMotionEstimateStatus();
+    fovis_info_msg.motion_estimate_status = 
+      fovis::MotionEstimateStatusCodeStrings[
+        fovis_info_msg.motion_estimate_status_code];
+    fovis_info_msg.num_matches = estimator->getNumMatches();
+    fovis_info_msg.num_inliers = estimator->getNumInliers();
+    fovis_info_msg.num_reprojection_failures =
+      estimator->getNumReprojectionFailures();
+    fovis_info_msg.motion_estimate_valid = 
+      estimator->isMotionEstimateValid();
+  }
+
+  /**
+   * Returns the pixels of image_msg as a packed gray image, converted
+   * into buffer if necessary. Encodings without a kernel in
+   * image_conversion are converted by cv_bridge first, cv_image keeps
+   * that conversion alive.
+   */
+  static const uint8_t* grayImageData(const sensor_msgs::Image& image_msg,
+      image_conversion::AlignedBuffer& buffer,
+      cv_bridge::CvImageConstPtr& cv_image)
+  {
+    cv_image.reset();
+    const uint8_t* data = image_conversion::grayData(image_msg.data.data(),
+        image_msg.step, image_msg.width, image_msg.height, image_msg.encoding,
+        buffer);
+    if (data) return data;
+    cv_image = cv_bridge::toCvCopy(image_msg, sensor_msgs::image_encodings::MONO8);
+    return image_conversion::grayData(cv_image->image.data,
+        cv_image->image.step[0], cv_image->image.cols, cv_image->image.rows,
+        sensor_msgs::image_encodings::MONO8, buffer);
+  }
+
+  /**
+   * Fills cloud with the 3D positions of the inlier matches of the last
+   * motion estimate in the (rectified) camera frame of the last image,
+   * reusing the memory of cloud.
+   */
+  static void fillInlierCloud(const fovis::VisualOdometry* visual_odometer,
+      pcl::PointCloud<pcl::PointXYZ>& cloud)
+  {
+    const fovis::MotionEstimator* estimator =
+      visual_odometer->getMotionEstimator();
+    const fovis::FeatureMatch* matches = estimator->getMatches();
+    const int num_matches = estimator->getNumMatches();
+    cloud.points.resize(estimator->getNumInliers());
+    size_t num_points = 0;
+    for (int i = 0; i < num_matches && num_points < cloud.points.size(); ++i)
+    {
+      if (!matches[i].inlier) continue;
+      // the refined keypoint has the depth the estimate was computed with
+      const Eigen::Vector3d& xyz = matches[i].refined_target_keypoint.xyz;
+      pcl::PointXYZ& point = cloud.points[num_points++];
+      point.x = xyz.x();
+      point.y = xyz.y();
+      point.z = xyz.z();
+    }
+    cloud.points.resize(num_points);
+    cloud.width = num_points;
+    cloud.height = 1;
+    cloud.is_dense = true;
+  }
 
 protected:
 
-  OdometerBase() : 
+  /**
+   * \param nh_local Private node handle used to read parameters and
+   *                 to advertise the output topics
+   * \param tf_listener Listener shared with other odometers of the
+   *                    process, a listener of its own is created if NULL
+   * \param pool If not NULL, frames are processed as tasks of this pool
+   *             (in order, one at a time) instead of in the calling
+   *             thread or the threads of the pipelined mode
+   */
+  OdometerBase(const ros::NodeHandle& nh_local,
+      const boost::shared_ptr<tf::TransformListener>& tf_listener =
+        boost::shared_ptr<tf::TransformListener>(),
+      WorkStealingPool* pool = NULL) : 
     visual_odometer_(NULL),
     rectification_(NULL),
     depth_source_(NULL),
+    rectification_table_(NULL),
     visual_odometer_options_(fovis::VisualOdometry::getDefaultOptions()),
-    nh_local_("~"),
+    rebuilding_(false),
+    rebuilt_odometer_(NULL),
+    reset_requested_(0),
+    feature_budget_(1.0),
+    active_feature_budget_(1.0),
+    budget_time_(-1.0),
+    budget_frames_(0),
+    pool_(pool),
+    strand_scheduled_(false),
+    strand_stopped_(false),
+    num_busy_drops_(0),
+    tf_listener_(tf_listener ?
+        tf_listener : boost::shared_ptr<tf::TransformListener>(
+          new tf::TransformListener())),
+    base_to_sensor_cached_(false),
+    base_to_sensor_invalid_(0),
+    imu_to_sensor_known_(false),
+    nh_local_(nh_local),
     it_(nh_local_)
   {
     loadParams();
     odom_pub_ = nh_local_.advertise<nav_msgs::Odometry>("odometry", 1);
     pose_pub_ = nh_local_.advertise<geometry_msgs::PoseStamped>("pose", 1);
     info_pub_ = nh_local_.advertise<FovisInfo>("info", 1);
+    inlier_cloud_pub_ =
+      nh_local_.advertise<sensor_msgs::PointCloud2>("inlier_cloud", 1);
     features_pub_ = it_.advertise("features", 1);
+    feature_data_pub_ = nh_local_.advertise<FovisFeatures>("feature_data", 1);
+    feature_image_worker_.reset(new FeatureImageWorker(
+          features_pub_, features_max_rate_, features_scale_));
+    requested_options_ = visual_odometer_options_;
+    set_options_srv_ = nh_local_.advertiseService("set_options",
+        &OdometerBase::setOptionsCallback, this);
+    reset_srv_ = nh_local_.advertiseService("reset",
+        &OdometerBase::resetCallback, this);
+
+    if (cache_base_to_sensor_)
+    {
+      // static transforms only change when /tf_static changes, the
+      // private handle carries the callback queue of the nodelet
+      tf_static_sub_ = nh_local_.subscribe("/tf_static", 10,
+          &OdometerBase::tfStaticCallback, this);
+    }
+
+    if (use_imu_)
+    {
+      // through the private handle, so that every odometer of a process
+      // (see fovis_multi_odometer) can be given its own imu
+      gyro_integrator_.reset(new GyroIntegrator());
+      imu_sub_ = nh_local_.subscribe("imu", 100, &OdometerBase::imuCallback, this);
+    }
+
+    if (pool_)
+    {
+      if (pipelined_)
+      {
+        ROS_WARN("~pipelined is ignored, frames are processed in the shared thread pool.");
+      }
+      results_.push_back(new Result);
+    }
+    else if (pipelined_)
+    {
+      startPipeline();
+    }
   }
 
   virtual ~OdometerBase()
   {
+    stopPipeline();
+    for (size_t i = 0; i < frames_.size(); ++i) delete frames_[i];
+    for (size_t i = 0; i < results_.size(); ++i) delete results_[i];
     if (visual_odometer_) delete visual_odometer_;
     if (rectification_) delete rectification_;
   }
 
+  /**
+   * Input data of one frame, converted to the packed formats libfovis
+   * expects. Implementing classes derive from this to add the data for
+   * their depth source. Frames are reused, so buffers should be kept
+   * between frames.
+   */
+  struct Frame
+  {
+    virtual ~Frame() {}
+
+    std_msgs::Header header;
+    sensor_msgs::CameraInfoConstPtr info_msg;
+    ros::WallTime start_time;
+    // time spent converting the input messages
+    double conversion_time;
+    // number of inputs dropped so far by the processor
+    int num_dropped_inputs;
+    // number of inputs dropped so far in pool mode because all frames
+    // were in use
+    int num_busy_drops;
+
+    // keep the image and the conversion by cv_bridge alive if they are
+    // used without a copy
+    sensor_msgs::ImageConstPtr image_msg;
+    cv_bridge::CvImageConstPtr cv_image;
+    const uint8_t* image_data;
+    // gray image, used for padded or non-gray input
+    image_conversion::AlignedBuffer image_buffer;
+    // rectified image, only used with a rectification table
+    std::vector<uint8_t> rectified_buffer;
+  };
+
+  /**
+   * Implement this method to create an empty frame of the type used by
+   * the implementing class.
+   */
+  virtual Frame* createFrame() const = 0;
+
+  /**
+   * Implement this method to pass the depth data of frame to the depth
+   * source. It is called right before the frame is processed, in
+   * pipelined mode this happens in the odometry thread.
+   */
+  virtual void updateDepthSource(const Frame& frame) = 0;
+
+  /**
+   * Implement this method if the depth source depends on the fovis
+   * options. It is called from a background thread when the options
+   * change and must not touch the current depth source.
+   * \return a new depth source for options, NULL to keep the current one
+   */
+  virtual fovis::DepthSource* rebuildDepthSource(
+      const fovis::VisualOdometryOptions& /*options*/)
+  {
+    return NULL;
+  }
+
+  /**
+   * Implement this method together with rebuildDepthSource(): takes
+   * ownership of a depth source created by it, which replaces the
+   * current one. Called in the odometry stage between two frames, the
+   * depth data of following frames has to be passed to depth_source.
+   */
+  virtual void replaceDepthSource(fovis::DepthSource* /*depth_source*/)
+  {
+  }
+
+  /**
+   * Returns a frame that can be filled with the input data. In pipelined
+   * mode this blocks while all frames are in use, in pool mode the input
+   * is dropped instead unless wait is set.
+   * \param wait pool mode: block until a frame is given back
+   * \return NULL if the pipeline has been stopped or no frame is free
+   */
+  Frame* acquireFrame(bool wait = false)
+  {
+    Frame* frame = NULL;
+    if (pool_)
+    {
+      boost::unique_lock<boost::mutex> lock(strand_mutex_);
+      if (frames_.empty())
+      {
+        for (int i = 0; i < NUM_PIPELINE_FRAMES; ++i)
+        {
+          frames_.push_back(createFrame());
+          idle_frames_.push_back(frames_.back());
+        }
+      }
+      while (wait && idle_frames_.empty() && !strand_stopped_)
+        frame_released_.wait(lock);
+      if (strand_stopped_) return NULL;
+      if (idle_frames_.empty())
+      {
+        ++num_busy_drops_;
+        ROS_DEBUG("Dropping input tuple, all frames are in use.");
+        return NULL;
+      }
+      frame = idle_frames_.back();
+      idle_frames_.pop_back();
+    }
+    else if (!pipelined_)
+    {
+      if (frames_.empty()) frames_.push_back(createFrame());
+      frame = frames_[0];
+    }
+    else
+    {
+      if (frames_.empty())
+      {
+        for (int i = 0; i < NUM_PIPELINE_FRAMES; ++i)
+        {
+          frames_.push_back(createFrame());
+          free_frames_->tryPush(frames_.back());
+        }
+      }
+      if (!free_frames_->pop(frame)) return NULL;
+    }
+    frame->start_time = ros::WallTime::now();
+    frame->num_dropped_inputs = 0;
+    frame->num_busy_drops = 0;
+    return frame;
+  }
+
+  /**
+   * Stops the threads of the pipelined mode, or the tasks of the pool
+   * mode, after all queued frames have been processed and published.
+   * Implementing classes have to call this in their destructor before
+   * destroying their depth source. A rebuilt odometer that has not been
+   * swapped in is destroyed here.
+   */
+  void stopPipeline()
+  {
+    // a rebuild may still call rebuildDepthSource(), no new ones are
+    // started once the service is shut down and rebuilding_ is set
+    set_options_srv_.shutdown();
+    {
+      boost::lock_guard<boost::mutex> lock(rebuild_mutex_);
+      rebuilding_ = true;
+      if (rebuild_thread_)
+      {
+        rebuild_thread_->join();
+        rebuild_thread_.reset();
+      }
+    }
+    if (pool_)
+    {
+      // frames arriving from now on are given back unprocessed
+      boost::unique_lock<boost::mutex> lock(strand_mutex_);
+      strand_stopped_ = true;
+      frame_released_.notify_all();
+      while (strand_scheduled_)
+        strand_idle_.wait(lock);
+    }
+    else if (odometry_thread_)
+    {
+      input_queue_->close();
+      odometry_thread_->join();
+      output_thread_->join();
+      odometry_thread_.reset();
+      output_thread_.reset();
+    }
+    if (rebuilt_odometer_)
+    {
+      delete rebuilt_odometer_->visual_odometer;
+      delete rebuilt_odometer_->rectification;
+      delete rebuilt_odometer_->depth_source;
+      delete rebuilt_odometer_;
+      rebuilt_odometer_ = NULL;
+    }
+  }
+
   const fovis::VisualOdometryOptions& getOptions() const
   {
     return visual_odometer_options_;
   }
 
+  tf::TransformListener& getTransformListener()
+  {
+    return *tf_listener_;
+  }
+
+  /**
+   * Makes process() rectify the (raw) input images with table, which has
+   * to stay valid. Has to be called before the first frame is processed.
+   */
+  void setRectificationTable(const image_conversion::RemapTable* table)
+  {
+    rectification_table_ = table;
+  }
+
   /**
    * Sets the depth source, must be called once before calling process()
    */
@@ -66,82 +500,553 @@ protected:
     depth_source_ = source;
   }
 
-  static void rosToFovis(const image_geometry::PinholeCameraModel& camera_model,
-      fovis::CameraIntrinsicsParameters& parameters)
+  /**
+   * To be called by implementing classes after the depth data has been
+   * stored in frame. Converts the image and processes the frame, in
+   * pipelined mode processing happens asynchronously.
+   * \param frame a frame obtained by acquireFrame()
+   */
+  void process(Frame* frame,
+      const sensor_msgs::ImageConstPtr& image_msg, 
+      const sensor_msgs::CameraInfoConstPtr& info_msg)
   {
-    parameters.cx = camera_model.cx();
-    parameters.cy = camera_model.cy();
-    parameters.fx = camera_model.fx();
-    parameters.fy = camera_model.fy();
-    parameters.width = camera_model.reducedResolution().width;
-    parameters.height = camera_model.reducedResolution().height;
+    frame->header = image_msg->header;
+    frame->info_msg = info_msg;
+
+    // libfovis needs packed gray images, convert or repack if necessary
+    frame->image_msg = image_msg;
+    frame->image_data =
+      grayImageData(*image_msg, frame->image_buffer, frame->cv_image);
+    if (rectification_table_)
+    {
+      frame->rectified_buffer.resize(
+          rectification_table_->width * rectification_table_->height);
+      image_conversion::remap(frame->image_data, *rectification_table_,
+          frame->rectified_buffer.data());
+      frame->image_data = frame->rectified_buffer.data();
+    }
+    frame->conversion_time =
+      (ros::WallTime::now() - frame->start_time).toSec();
+
+    if (pool_)
+    {
+      schedule(frame);
+    }
+    else if (!pipelined_)
+    {
+      if (results_.empty()) results_.push_back(new Result);
+      estimateMotion(*frame, *results_[0]);
+      publishResult(*results_[0]);
+    }
+    else
+    {
+      // if the pipeline has been stopped the frame is dropped, it is
+      // owned by frames_ and the odometry thread is the only producer
+      // of free_frames_
+      input_queue_->push(frame);
+    }
   }
 
+
+private:
+
+  struct RebuiltOdometer;
+
   /**
-   * To be called by implementing classes after the depth source has
-   * been fed with data.
+   * Output of the odometry stage for one frame, everything needed to
+   * publish messages and tf.
    */
-  void process(
-      const sensor_msgs::ImageConstPtr& image_msg, 
-      const sensor_msgs::CameraInfoConstPtr& info_msg)
+  struct Result
   {
-    ros::WallTime start_time = ros::WallTime::now();
+    std_msgs::Header header;
+    ros::WallTime start_time;
+    fovis::MotionEstimateStatusCode status;
+    Eigen::Isometry3d pose;
+    Eigen::Isometry3d motion;
+    Eigen::Matrix<double, 6, 6> motion_cov;
+    Eigen::Matrix<double, 6, 6> pose_cov;
+    // info_msg is only filled if there were subscribers at the time
+    bool publish_info;
+    FovisInfo info_msg;
+    // features_msg is only filled if there were subscribers at the time
+    bool publish_features;
+    FovisFeatures features_msg;
+    // inlier_cloud is only filled if there were subscribers at the time,
+    // the memory of the points is reused across frames
+    bool publish_inlier_cloud;
+    pcl::PointCloud<pcl::PointXYZ> inlier_cloud;
+    // the frame is the new origin, no twist is computed for it
+    bool reset;
 
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+  };
+
+  /**
+   * Odometry stage: feeds depth source and odometer with the frame and
+   * collects the results. Only stage that accesses the odometer.
+   */
+  void estimateMotion(const Frame& frame, Result& result)
+  {
     bool first_run = false;
     if (visual_odometer_ == NULL)
     {
       first_run = true;
-      initOdometer(info_msg);
+      initOdometer(frame.info_msg);
     }
     ROS_ASSERT(visual_odometer_ != NULL);
     ROS_ASSERT(depth_source_ != NULL);
+    FovisInfo& fovis_info_msg = result.info_msg;
 
-    // convert image if necessary
-    uint8_t *image_data;
-    cv_bridge::CvImageConstPtr cv_ptr = 
-      cv_bridge::toCvShare(image_msg, sensor_msgs::image_encodings::MONO8);
-    image_data = cv_ptr->image.data;
-    int step = cv_ptr->image.step[0];
-
-    ROS_ASSERT(step == static_cast<int>(image_msg->width));
+    // pass depth data to depth source
+    ros::WallTime stage_start = ros::WallTime::now();
+    updateDepthSource(frame);
+    ros::WallTime stage_end = ros::WallTime::now();
+    fovis_info_msg.depth_update_time = (stage_end - stage_start).toSec();
 
     // pass image to odometer
-    visual_odometer_->processFrame(image_data, depth_source_);
+    stage_start = stage_end;
+    visual_odometer_->processFrame(frame.image_data, depth_source_);
+    stage_end = ros::WallTime::now();
+    fovis_info_msg.process_frame_time = (stage_end - stage_start).toSec();
+
+    result.header = frame.header;
+    result.start_time = frame.start_time;
 
-    // skip visualization on first run as no reference image is present
-    if (!first_run && features_pub_.getNumSubscribers() > 0)
+    // skip visualization on first run as no reference image is present,
+    // painting happens in the worker thread
+    fovis_info_msg.visualization_time = 0.0;
+    if (!first_run && feature_image_worker_->ready())
     {
-      cv_bridge::CvImage cv_image;
-      cv_image.header.stamp = image_msg->header.stamp;
-      cv_image.header.frame_id = image_msg->header.frame_id;
-      cv_image.encoding = sensor_msgs::image_encodings::BGR8;
-      cv_image.image = visualization::paint(visual_odometer_);
-      features_pub_.publish(cv_image.toImageMsg());
+      stage_start = stage_end;
+      visualization::takeSnapshot(
+          visual_odometer_, feature_image_worker_->snapshot());
+      feature_image_worker_->submit(frame.header);
+      fovis_info_msg.visualization_time =
+        (ros::WallTime::now() - stage_start).toSec();
+    }
+    result.publish_features =
+      !first_run && feature_data_pub_.getNumSubscribers() > 0;
+    if (result.publish_features)
+    {
+      stage_start = ros::WallTime::now();
+      visualization::takeSnapshot(visual_odometer_, features_snapshot_, false);
+      visualization::toMsg(features_snapshot_, result.features_msg);
+      result.features_msg.header = frame.header;
+      fovis_info_msg.visualization_time +=
+        (ros::WallTime::now() - stage_start).toSec();
     }
 
+    // a requested reset makes this frame the new origin
+    result.reset = reset_requested_ &&
+      __sync_bool_compare_and_swap(&reset_requested_, 1, 0);
+    if (result.reset)
+    {
+      pose_offset_ = visual_odometer_->getPose().inverse();
+      pose_cov_.setZero();
+    }
+    // rotation since the previous frame as measured by the gyro
+    Eigen::Quaterniond gyro_rotation;
+    const bool gyro_valid =
+      gyro_integrator_ && integrateGyro(frame.header, gyro_rotation);
+    result.status = visual_odometer_->getMotionEstimateStatus();
+    if (result.status == fovis::SUCCESS)
+    {
+      result.pose = pose_offset_ * visual_odometer_->getPose();
+      result.motion = visual_odometer_->getMotionEstimate();
+      result.motion_cov = visual_odometer_->getMotionEstimateCov();
+      if (!result.reset)
+      {
+        propagatePoseCovariance(result.motion, result.motion_cov);
+      }
+    }
+    else if (gyro_valid && !result.reset)
+    {
+      // the odometer continues from its last pose with this frame as
+      // reference, keep the rotation the gyro measured in between
+      const Eigen::Isometry3d& pose = visual_odometer_->getPose();
+      pose_offset_ = pose_offset_ * pose * Eigen::Isometry3d(gyro_rotation) *
+        pose.inverse();
+    }
+    result.pose_cov = pose_cov_;
+
+    result.publish_inlier_cloud =
+      !first_run && inlier_cloud_pub_.getNumSubscribers() > 0;
+    if (result.publish_inlier_cloud)
+    {
+      fillInlierCloud(visual_odometer_, result.inlier_cloud);
+    }
+
+    // fill fovis info msg, timing is cheap and always collected
+    fovis_info_msg.conversion_time = frame.conversion_time;
+    result.publish_info = info_pub_.getNumSubscribers() > 0;
+    if (result.publish_info)
+    {
+      fovis_info_msg.header.stamp = frame.header.stamp;
+      fillInfo(visual_odometer_, fovis_info_msg);
+      fovis_info_msg.num_dropped_inputs = frame.num_dropped_inputs;
+      fovis_info_msg.num_busy_drops = frame.num_busy_drops;
+      fillOperatingPoint(fovis_info_msg);
+      fovis_info_msg.gyro_valid = gyro_valid;
+      fovis_info_msg.gyro_angle = 0.0;
+      fovis_info_msg.gyro_angle_error = 0.0;
+      if (gyro_valid)
+      {
+        fovis_info_msg.gyro_angle = Eigen::AngleAxisd(gyro_rotation).angle();
+        if (result.status == fovis::SUCCESS)
+        {
+          Eigen::Quaterniond visual_rotation(result.motion.rotation());
+          fovis_info_msg.gyro_angle_error = Eigen::AngleAxisd(
+              visual_rotation.conjugate() * gyro_rotation).angle();
+        }
+      }
+    }
+
+    // the swap is reported as part of processing the frame, the
+    // controller skips the frame as its time is not representative
+    if (rebuilt_odometer_)
+    {
+      stage_start = ros::WallTime::now();
+      swapOdometer(frame);
+      fovis_info_msg.process_frame_time +=
+        (ros::WallTime::now() - stage_start).toSec();
+    }
+    else if (target_process_frame_time_ > 0.0)
+    {
+      updateFeatureBudget(fovis_info_msg.process_frame_time);
+    }
+  }
+
+  /**
+   * Called from the spinner thread: starts building an odometer with the
+   * changed options in the background, it is swapped in by the odometry
+   * stage.
+   */
+  bool setOptionsCallback(SetOptions::Request& request,
+      SetOptions::Response& response)
+  {
+    response.success = false;
+    if (request.names.size() != request.values.size())
+    {
+      response.message = "names and values differ in size";
+      return true;
+    }
+    boost::lock_guard<boost::mutex> lock(rebuild_mutex_);
+    if (!camera_info_)
+    {
+      response.message = "no frame has been processed yet, set the parameters instead";
+      return true;
+    }
+    if (rebuilding_)
+    {
+      response.message = "the previous change has not been applied yet";
+      return true;
+    }
+    fovis::VisualOdometryOptions options = requested_options_;
+    for (size_t i = 0; i < request.names.size(); ++i)
+    {
+      std::string key = request.names[i];
+      std::replace(key.begin(), key.end(), '_', '-');
+      if (options.find(key) == options.end())
+      {
+        response.message = "unknown option " + request.names[i];
+        return true;
+      }
+      options[key] = request.values[i];
+    }
+    // keep the parameters in sync, e.g. for a restart of the node
+    for (size_t i = 0; i < request.names.size(); ++i)
+    {
+      nh_local_.setParam(request.names[i], request.values[i]);
+    }
+    requested_options_ = options;
+    startRebuild(feature_budget_, true);
+    response.success = true;
+    return true;
+  }
+
+  void imuCallback(const sensor_msgs::ImuConstPtr& imu_msg)
+  {
+    gyro_integrator_->push(*imu_msg);
+  }
+
+  /**
+   * Integrates the gyro from the previous frame to the frame with the
+   * given header and rotates the result into the sensor frame. The
+   * rotation from IMU to sensor is looked up once and then kept.
+   * \return false if there is no previous frame, the gyro samples do not
+   *         cover the interval yet or the transform is not available
+   */
+  bool integrateGyro(const std_msgs::Header& header,
+      Eigen::Quaterniond& rotation)
+  {
+    const ros::Time from = last_frame_stamp_;
+    last_frame_stamp_ = header.stamp;
+    if (from.isZero() || !gyro_integrator_->integrate(
+          from.toSec(), header.stamp.toSec(), rotation))
+      return false;
+    if (!imu_to_sensor_known_)
+    {
+      const std::string& imu_frame_id = gyro_integrator_->frameId();
+      std::string error_msg;
+      if (!tf_listener_->canTransform(header.frame_id, imu_frame_id,
+            ros::Time(0), &error_msg))
+      {
+        ROS_WARN_THROTTLE(10.0, "The tf from '%s' to '%s' is not available, "
+                                "gyro data is not used.",
+                                header.frame_id.c_str(), imu_frame_id.c_str());
+        ROS_DEBUG("Transform error: %s", error_msg.c_str());
+        return false;
+      }
+      tf::StampedTransform sensor_to_imu;
+      tf_listener_->lookupTransform(header.frame_id, imu_frame_id,
+          ros::Time(0), sensor_to_imu);
+      tf::Quaternion q = sensor_to_imu.getRotation();
+      imu_to_sensor_ = Eigen::Quaterniond(q.w(), q.x(), q.y(), q.z());
+      imu_to_sensor_known_ = true;
+    }
+    rotation = imu_to_sensor_ * rotation * imu_to_sensor_.conjugate();
+    return true;
+  }
+
+  /**
+   * Called from the spinner thread: the next frame the odometry stage
+   * processes becomes the origin of the reported pose. Odometer, depth
+   * source and buffers are kept.
+   */
+  bool resetCallback(std_srvs::Empty::Request&, std_srvs::Empty::Response&)
+  {
+    __sync_lock_test_and_set(&reset_requested_, 1);
+    ROS_INFO("Resetting odometry at the next frame.");
+    return true;
+  }
+
+  /**
+   * Starts building an odometer with the requested options, reduced to
+   * budget. The caller has to hold rebuild_mutex_ and make sure that no
+   * rebuild is in progress.
+   * \param log whether to log the options once they are applied
+   */
+  void startRebuild(double budget, bool log)
+  {
+    RebuiltOdometer* rebuilt = new RebuiltOdometer;
+    applyFeatureBudget(requested_options_, budget, rebuilt->options);
+    rebuilt->feature_budget = budget;
+    rebuilt->log = log;
+    rebuilding_ = true;
+    if (rebuild_thread_) rebuild_thread_->join();
+    rebuild_thread_.reset(new boost::thread(
+          boost::bind(&OdometerBase::rebuildOdometer, this, rebuilt)));
+  }
+
+  /**
+   * Reduces the feature budget knobs of options: at budget 1 they are
+   * left as they are, at 0 they are at the bounds given by the
+   * ~budget_* parameters. Pixels per feature and bucket size are
+   * interpolated geometrically, the pyramid level linearly.
+   */
+  void applyFeatureBudget(const fovis::VisualOdometryOptions& options,
+      double budget, fovis::VisualOdometryOptions& result) const
+  {
+    result = options;
+    if (budget >= 1.0) return;
+    const double lean = 1.0 - budget;
+    const double pixels_per_feature_scale =
+      std::pow(budget_pixels_per_feature_scale_, lean);
+    const double bucket_scale = std::pow(budget_bucket_scale_, lean);
+    scaleOption(result, "target-pixels-per-feature", pixels_per_feature_scale);
+    scaleOption(result, "bucket-width", bucket_scale);
+    scaleOption(result, "bucket-height", bucket_scale);
+    int max_level = atoi(result["max-pyramid-level"].c_str());
+    if (max_level > budget_min_pyramid_level_)
+    {
+      max_level -= static_cast<int>(
+          lean * (max_level - budget_min_pyramid_level_) + 0.5);
+      result["max-pyramid-level"] = toString(max_level);
+    }
+  }
+
+  static void scaleOption(fovis::VisualOdometryOptions& options,
+      const std::string& key, double scale)
+  {
+    double value = atof(options[key].c_str()) * scale;
+    options[key] = toString(static_cast<int>(value + 0.5));
+  }
+
+  template<typename T>
+  static std::string toString(T value)
+  {
+    std::stringstream stream;
+    stream << value;
+    return stream.str();
+  }
+
+  /**
+   * Feature budget controller, called by the odometry stage after each
+   * frame: keeps the smoothed processFrame() time at
+   * ~target_process_frame_time by rebuilding the odometer with a smaller
+   * budget when it is clearly above the target, and with a larger one
+   * when it is well below; in between the budget is kept. Changes are
+   * spaced by SETTLE_FRAMES frames, so that the effect of the previous
+   * one can be measured, and by MIN_INTERVAL seconds, as each costs a
+   * rebuild. The frame a change is swapped in at is processed twice
+   * (see swapOdometer()) and is not passed to the controller.
+   */
+  void updateFeatureBudget(double process_frame_time)
+  {
+    static const double SMOOTHING = 0.2;
+    static const int SETTLE_FRAMES = 10;
+    static const double MIN_INTERVAL = 1.0;
+    static const double TOLERANCE = 1.05;
+    static const double HEADROOM = 0.8;
+    static const double MIN_STEP = 0.02;
+    static const double MAX_STEP = 0.25;
+    static const double RAISE_STEP = 0.05;
+
+    if (budget_time_ < 0.0) budget_time_ = process_frame_time;
+    budget_time_ += SMOOTHING * (process_frame_time - budget_time_);
+    if (++budget_frames_ < SETTLE_FRAMES) return;
+    const ros::WallTime now = ros::WallTime::now();
+    if ((now - budget_change_time_).toSec() < MIN_INTERVAL) return;
+
+    const double ratio = budget_time_ / target_process_frame_time_;
+    double budget = feature_budget_;
+    if (ratio > TOLERANCE)
+    {
+      // back off in proportion to the overrun
+      budget -= std::max(MIN_STEP, std::min(MAX_STEP, 0.5 * (ratio - 1.0)));
+    }
+    else if (ratio < HEADROOM)
+    {
+      budget += RAISE_STEP;
+    }
+    budget = std::max(0.0, std::min(1.0, budget));
+    if (budget == feature_budget_) return;
+
+    boost::lock_guard<boost::mutex> lock(rebuild_mutex_);
+    if (rebuilding_) return;
+    fovis::VisualOdometryOptions current, options;
+    applyFeatureBudget(requested_options_, feature_budget_, current);
+    applyFeatureBudget(requested_options_, budget, options);
+    feature_budget_ = budget;
+    // small changes may round to the same options
+    if (options == current) return;
+    startRebuild(budget, false);
+    budget_frames_ = 0;
+    budget_change_time_ = now;
+  }
+
+  /**
+   * Fills the operating point of the feature budget controller, i.e. the
+   * budget and options of the running odometer.
+   */
+  void fillOperatingPoint(FovisInfo& fovis_info_msg)
+  {
+    fovis_info_msg.feature_budget = active_feature_budget_;
+    fovis_info_msg.target_pixels_per_feature =
+      atoi(visual_odometer_options_["target-pixels-per-feature"].c_str());
+    fovis_info_msg.max_pyramid_level =
+      atoi(visual_odometer_options_["max-pyramid-level"].c_str());
+    fovis_info_msg.bucket_width =
+      atoi(visual_odometer_options_["bucket-width"].c_str());
+    fovis_info_msg.bucket_height =
+      atoi(visual_odometer_options_["bucket-height"].c_str());
+  }
+
+  /**
+   * Rebuild thread: creates odometer and depth source for the options of
+   * rebuilt and hands them over to the odometry stage.
+   */
+  void rebuildOdometer(RebuiltOdometer* rebuilt)
+  {
+    rebuilt->visual_odometer = createVisualOdometry(camera_info_,
+        rebuilt->options, rebuilt->rectification);
+    rebuilt->depth_source = rebuildDepthSource(rebuilt->options);
+    __sync_bool_compare_and_swap(&rebuilt_odometer_,
+        static_cast<RebuiltOdometer*>(NULL), rebuilt);
+  }
+
+  /**
+   * Replaces odometer and depth source by the rebuilt ones. The new
+   * odometer processes frame as its first reference frame, so the motion
+   * to the next frame is not lost, and continues from the pose of the
+   * old one.
+   */
+  void swapOdometer(const Frame& frame)
+  {
+    RebuiltOdometer* rebuilt = __sync_lock_test_and_set(&rebuilt_odometer_,
+        static_cast<RebuiltOdometer*>(NULL));
+    if (rebuilt->depth_source)
+    {
+      replaceDepthSource(rebuilt->depth_source);
+      updateDepthSource(frame);
+    }
+    rebuilt->visual_odometer->processFrame(frame.image_data, depth_source_);
+    pose_offset_ = pose_offset_ * visual_odometer_->getPose();
+    delete visual_odometer_;
+    delete rectification_;
+    visual_odometer_ = rebuilt->visual_odometer;
+    rectification_ = rebuilt->rectification;
+    visual_odometer_options_ = rebuilt->options;
+    active_feature_budget_ = rebuilt->feature_budget;
+    if (rebuilt->log) logOptions("Changed fovis options");
+    delete rebuilt;
+    // the controller measures the new options from here
+    budget_frames_ = 0;
+    boost::lock_guard<boost::mutex> lock(rebuild_mutex_);
+    rebuilding_ = false;
+  }
+
+  /**
+   * Output stage: calculates odometry and pose of the base and publishes
+   * messages and tf.
+   */
+  void publishResult(Result& result)
+  {
+    const std_msgs::Header& header = result.header;
+    ros::WallTime publish_start = ros::WallTime::now();
+    result.info_msg.tf_lookup_time = 0.0;
+
+    // messages are only assembled if someone listens, tf is always sent
+    const bool publish_odom = odom_pub_.getNumSubscribers() > 0;
+    const bool publish_pose = pose_pub_.getNumSubscribers() > 0;
+
     // create odometry and pose messages
-    odom_msg_.header.stamp = image_msg->header.stamp;
-    odom_msg_.header.frame_id = odom_frame_id_;
-    odom_msg_.child_frame_id = base_link_frame_id_;
-    
-    pose_msg_.header.stamp = image_msg->header.stamp;
-    pose_msg_.header.frame_id = base_link_frame_id_;
+    if (publish_odom)
+    {
+      odom_msg_.header.stamp = header.stamp;
+      odom_msg_.header.frame_id = odom_frame_id_;
+      odom_msg_.child_frame_id = base_link_frame_id_;
+    }
+    if (publish_pose)
+    {
+      pose_msg_.header.stamp = header.stamp;
+      pose_msg_.header.frame_id = base_link_frame_id_;
+    }
 
     // on success, start fill message and tf
-    fovis::MotionEstimateStatusCode status = 
-      visual_odometer_->getMotionEstimateStatus();
-    if (status == fovis::SUCCESS)
+    fovis::MotionEstimateStatusCode status = result.status;
+    if (result.reset) last_time_ = ros::Time(0);
+    if (status == fovis::SUCCESS &&
+        !publish_tf_ && !publish_odom && !publish_pose)
+    {
+      // nothing to compute, but keep the time for the next twist
+      last_time_ = header.stamp;
+    }
+    else if (status == fovis::SUCCESS)
     {
       // get pose and motion from odometer
-      const Eigen::Isometry3d& pose = visual_odometer_->getPose();
+      const Eigen::Isometry3d& pose = result.pose;
       tf::Transform sensor_pose;
       eigenToTF(pose, sensor_pose);
       // calculate transform of odom to base based on base to sensor 
       // and sensor to sensor
       tf::StampedTransform current_base_to_sensor;
+      ros::WallTime lookup_start = ros::WallTime::now();
       getBaseToSensorTransform(
-          image_msg->header.stamp, image_msg->header.frame_id, 
+          header.stamp, header.frame_id, 
           current_base_to_sensor);
+      result.info_msg.tf_lookup_time =
+        (ros::WallTime::now() - lookup_start).toSec();
       tf::Transform base_transform = 
         initial_base_to_sensor_ * sensor_pose * current_base_to_sensor.inverse();
 
@@ -149,20 +1054,28 @@ protected:
       if (publish_tf_)
       {
         tf_broadcaster_.sendTransform(
-            tf::StampedTransform(base_transform, image_msg->header.stamp,
+            tf::StampedTransform(base_transform, header.stamp,
             odom_frame_id_, base_link_frame_id_));
       }
 
       // fill odometry and pose msg
-      tf::poseTFToMsg(base_transform, odom_msg_.pose.pose);
-      pose_msg_.pose = odom_msg_.pose.pose;
+      if (publish_pose)
+      {
+        tf::poseTFToMsg(base_transform, pose_msg_.pose);
+      }
+      if (publish_odom)
+      {
+        tf::poseTFToMsg(base_transform, odom_msg_.pose.pose);
+        fillPoseCovariance(result.pose_cov, current_base_to_sensor,
+            base_transform, odom_msg_.pose.covariance);
+      }
 
       // can we calculate velocities?
       double dt = last_time_.isZero() ? 
-        0.0 : (image_msg->header.stamp - last_time_).toSec();
-      if (dt > 0.0)
+        0.0 : (header.stamp - last_time_).toSec();
+      if (publish_odom && dt > 0.0)
       {
-        const Eigen::Isometry3d& motion = visual_odometer_->getMotionEstimate();
+        const Eigen::Isometry3d& motion = result.motion;
         tf::Transform sensor_motion;
         eigenToTF(motion, sensor_motion);
         // in theory the first factor would have to be base_to_sensor of t-1
@@ -182,21 +1095,12 @@ protected:
         odom_msg_.twist.twist.angular.z = angular_twist.z();
 
         // add covariance
-        const Eigen::MatrixXd& motion_cov = visual_odometer_->getMotionEstimateCov();
+        const Eigen::Matrix<double, 6, 6>& motion_cov = result.motion_cov;
         for (int i=0;i<6;i++)
           for (int j=0;j<6;j++)
             odom_msg_.twist.covariance[j*6+i] = motion_cov(i,j);
-	srand(47);  // get same covariance values
-        for (int i=0;i<6;i++)
-          for (int j=0;j<=i;j++){
-	    double cov_val =  i==j ? 1.0e-7 : random_sign()*1.0e-11;
-            odom_msg_.pose.covariance[j*6+i] = cov_val;
-	    odom_msg_.pose.covariance[i*6+j] = cov_val;
-          }
-
       }
-      // TODO integrate covariance for pose covariance
-      last_time_ = image_msg->header.stamp;
+      last_time_ = header.stamp;
     }
     else
     {
@@ -205,75 +1109,210 @@ protected:
           fovis::MotionEstimateStatusCodeStrings[status]);
       last_time_ = ros::Time(0);
     }
-    odom_pub_.publish(odom_msg_);
-    pose_pub_.publish(pose_msg_);
+    if (publish_odom) odom_pub_.publish(odom_msg_);
+    if (publish_pose) pose_pub_.publish(pose_msg_);
+    if (result.publish_inlier_cloud)
+    {
+      pcl::toROSMsg(result.inlier_cloud, inlier_cloud_msg_);
+      inlier_cloud_msg_.header = header;
+      inlier_cloud_pub_.publish(inlier_cloud_msg_);
+    }
 
-    // create and publish fovis info msg
-    FovisInfo fovis_info_msg;
-    fovis_info_msg.header.stamp = image_msg->header.stamp;
-    fovis_info_msg.change_reference_frame = 
-      visual_odometer_->getChangeReferenceFrames();
-    fovis_info_msg.fast_threshold =
-      visual_odometer_->getFastThreshold();
-    const fovis::OdometryFrame* frame = 
-      visual_odometer_->getTargetFrame();
-    fovis_info_msg.num_total_detected_keypoints =
-      frame->getNumDetectedKeypoints();
-    fovis_info_msg.num_total_keypoints = frame->getNumKeypoints();
-    fovis_info_msg.num_detected_keypoints.resize(frame->getNumLevels());
-    fovis_info_msg.num_keypoints.resize(frame->getNumLevels());
-    for (int i = 0; i < frame->getNumLevels(); ++i)
+    // publish fovis info msg, in pipelined mode the runtime includes
+    // the time spent waiting in the queues
+    ros::WallTime publish_end = ros::WallTime::now();
+    result.info_msg.publish_time = (publish_end - publish_start).toSec() -
+      result.info_msg.tf_lookup_time;
+    ros::WallDuration time_elapsed = publish_end - result.start_time;
+    result.info_msg.runtime = time_elapsed.toSec();
+    result.info_msg.latency = (ros::Time::now() - header.stamp).toSec();
+    if (result.publish_info) info_pub_.publish(result.info_msg);
+    if (result.publish_features) feature_data_pub_.publish(result.features_msg);
+  }
+
+  void startPipeline()
+  {
+    input_queue_.reset(new SpscQueue<Frame*>(NUM_PIPELINE_FRAMES));
+    free_frames_.reset(new SpscQueue<Frame*>(NUM_PIPELINE_FRAMES));
+    output_queue_.reset(new SpscQueue<Result*>(NUM_PIPELINE_RESULTS));
+    free_results_.reset(new SpscQueue<Result*>(NUM_PIPELINE_RESULTS));
+    for (int i = 0; i < NUM_PIPELINE_RESULTS; ++i)
     {
-      fovis_info_msg.num_detected_keypoints[i] =
-        frame->getLevel(i)->getNumDetectedKeypoints();
-      fovis_info_msg.num_keypoints[i] =
-        frame->getLevel(i)->getNumKeypoints();
+      results_.push_back(new Result);
+      free_results_->tryPush(results_.back());
     }
-    const fovis::MotionEstimator* estimator = 
-      visual_odometer_->getMotionEstimator();
-    fovis_info_msg.motion_estimate_status_code =
-      estimator->getMotionEstimateStatus();
-    fovis_info_msg.motion_estimate_status = 
-      fovis::MotionEstimateStatusCodeStrings[
-        fovis_info_msg.motion_estimate_status_code];
-    fovis_info_msg.num_matches = estimator->getNumMatches();
-    fovis_info_msg.num_inliers = estimator->getNumInliers();
-    fovis_info_msg.num_reprojection_failures =
-      estimator->getNumReprojectionFailures();
-    fovis_info_msg.motion_estimate_valid = 
-      estimator->isMotionEstimateValid();
-    ros::WallDuration time_elapsed = ros::WallTime::now() - start_time;
-    fovis_info_msg.runtime = time_elapsed.toSec();
-    info_pub_.publish(fovis_info_msg);
+    odometry_thread_.reset(
+        new boost::thread(boost::bind(&OdometerBase::odometryLoop, this)));
+    output_thread_.reset(
+        new boost::thread(boost::bind(&OdometerBase::outputLoop, this)));
   }
 
+  void odometryLoop()
+  {
+    Frame* frame;
+    while (input_queue_->pop(frame))
+    {
+      Result* result;
+      free_results_->pop(result);
+      estimateMotion(*frame, *result);
+      free_frames_->push(frame);
+      output_queue_->push(result);
+    }
+    output_queue_->close();
+  }
 
-private:
+  void outputLoop()
+  {
+    Result* result;
+    while (output_queue_->pop(result))
+    {
+      publishResult(*result);
+      free_results_->push(result);
+    }
+  }
+
+  /**
+   * Pool mode: queues frame and submits a task for this odometer unless
+   * one is queued or running already. As there is at most one task per
+   * odometer, frames are processed one at a time and in order.
+   */
+  void schedule(Frame* frame)
+  {
+    boost::lock_guard<boost::mutex> lock(strand_mutex_);
+    if (strand_stopped_)
+    {
+      idle_frames_.push_back(frame);
+      return;
+    }
+    frame->num_busy_drops = num_busy_drops_;
+    pending_frames_.push_back(frame);
+    if (!strand_scheduled_)
+    {
+      strand_scheduled_ = true;
+      pool_->submit(boost::bind(&OdometerBase::runStrand, this));
+    }
+  }
+
+  /**
+   * Pool mode task: processes and publishes the queued frames until
+   * there are none left.
+   */
+  void runStrand()
+  {
+    while (true)
+    {
+      Frame* frame;
+      {
+        boost::lock_guard<boost::mutex> lock(strand_mutex_);
+        if (pending_frames_.empty())
+        {
+          strand_scheduled_ = false;
+          strand_idle_.notify_all();
+          return;
+        }
+        frame = pending_frames_.front();
+        pending_frames_.pop_front();
+      }
+      estimateMotion(*frame, *results_[0]);
+      publishResult(*results_[0]);
+      boost::lock_guard<boost::mutex> lock(strand_mutex_);
+      idle_frames_.push_back(frame);
+      frame_released_.notify_one();
+    }
+  }
+
+  /**
+   * Computes the adjoint of transform, which maps twists (translation
+   * first, then rotation) in the local frame of transform to the frame
+   * transform is given in.
+   */
+  static void computeAdjoint(const Eigen::Isometry3d& transform,
+      Eigen::Matrix<double, 6, 6>& adjoint)
+  {
+    const Eigen::Matrix3d rotation = transform.linear();
+    const Eigen::Vector3d& t = transform.translation();
+    Eigen::Matrix3d skew;
+    skew <<    0.0, -t.z(),  t.y(),
+             t.z(),    0.0, -t.x(),
+            -t.y(),  t.x(),    0.0;
+    adjoint.topLeftCorner<3, 3>() = rotation;
+    adjoint.topRightCorner<3, 3>() = skew * rotation;
+    adjoint.bottomLeftCorner<3, 3>().setZero();
+    adjoint.bottomRightCorner<3, 3>() = rotation;
+  }
+
+  /**
+   * Propagates the covariance of the sensor pose through the composition
+   * pose * motion. Covariances are of perturbations in the local frame
+   * of the sensor, ordered (x, y, z, rotation about x, y, z) like the
+   * motion estimate covariance. Correlations between motion estimates
+   * that share a reference frame are ignored, which overestimates the
+   * covariance.
+   */
+  void propagatePoseCovariance(const Eigen::Isometry3d& motion,
+      const Eigen::Matrix<double, 6, 6>& motion_cov)
+  {
+    Eigen::Matrix<double, 6, 6> adjoint;
+    computeAdjoint(motion.inverse(), adjoint);
+    pose_cov_ = adjoint * pose_cov_ * adjoint.transpose() + motion_cov;
+  }
+
+  /**
+   * Fills the covariance of the base pose as ROS expects it: position
+   * and orientation errors in the odometry frame, with orientation errors
+   * as rotations about its fixed axes.
+   * \param sensor_pose_cov covariance of the sensor pose in its local
+   *        frame, see propagatePoseCovariance()
+   */
+  void fillPoseCovariance(const Eigen::Matrix<double, 6, 6>& sensor_pose_cov,
+      const tf::Transform& base_to_sensor, const tf::Transform& base_pose,
+      boost::array<double, 36>& covariance)
+  {
+    Eigen::Isometry3d base_to_sensor_eigen, base_pose_eigen;
+    tfToEigen(base_to_sensor, base_to_sensor_eigen);
+    tfToEigen(base_pose, base_pose_eigen);
+    // local sensor frame to local base frame to odometry frame
+    Eigen::Matrix<double, 6, 6> jacobian;
+    computeAdjoint(base_to_sensor_eigen, jacobian);
+    jacobian.topRows<3>() =
+      base_pose_eigen.linear() * jacobian.topRows<3>();
+    jacobian.bottomRows<3>() =
+      base_pose_eigen.linear() * jacobian.bottomRows<3>();
+    Eigen::Matrix<double, 6, 6> base_pose_cov =
+      jacobian * sensor_pose_cov * jacobian.transpose();
+    for (int i = 0; i < 6; ++i)
+      for (int j = 0; j < 6; ++j)
+        covariance[i * 6 + j] = base_pose_cov(i, j);
+  }
 
   /**
    * Initializes the visual odometry. 
    */
   void initOdometer(const sensor_msgs::CameraInfoConstPtr& info_msg)
   {
-    // create rectification
-    image_geometry::PinholeCameraModel model;
-    model.fromCameraInfo(info_msg);
-    fovis::CameraIntrinsicsParameters cam_params;
-    rosToFovis(model, cam_params);
-    fovis::Rectification* rectification = new fovis::Rectification(cam_params);
-
     // instanciate odometer
-    visual_odometer_ = 
-      new fovis::VisualOdometry(rectification, visual_odometer_options_);
+    visual_odometer_ = createVisualOdometry(info_msg,
+        visual_odometer_options_, rectification_);
+    pose_cov_.setZero();
+    pose_offset_.setIdentity();
+    {
+      boost::lock_guard<boost::mutex> lock(rebuild_mutex_);
+      camera_info_ = info_msg;
+    }
 
     // store initial transform for later usage
     getBaseToSensorTransform(info_msg->header.stamp, 
         info_msg->header.frame_id,
         initial_base_to_sensor_);
 
-    // print options
+    logOptions(std::string("Initialized fovis odometry (") +
+        image_conversion::instructionSet() + " conversion kernels)");
+  }
+
+  void logOptions(const std::string& what)
+  {
     std::stringstream info;
-    info << "Initialized fovis odometry with the following options:\n";
+    info << what << " with the following options:\n";
     for (fovis::VisualOdometryOptions::iterator iter = visual_odometer_options_.begin();
         iter != visual_odometer_options_.end();
         ++iter)
@@ -293,6 +1332,16 @@ private:
     nh_local_.param("odom_frame_id", odom_frame_id_, std::string("/odom"));
     nh_local_.param("base_link_frame_id", base_link_frame_id_, std::string("/base_link"));
     nh_local_.param("publish_tf", publish_tf_, true);
+    nh_local_.param("pipelined", pipelined_, false);
+    nh_local_.param("cache_base_to_sensor", cache_base_to_sensor_, false);
+    nh_local_.param("features_max_rate", features_max_rate_, 0.0);
+    nh_local_.param("features_scale", features_scale_, 1.0);
+    nh_local_.param("use_imu", use_imu_, false);
+    nh_local_.param("target_process_frame_time", target_process_frame_time_, 0.0);
+    nh_local_.param("budget_pixels_per_feature_scale",
+        budget_pixels_per_feature_scale_, 4.0);
+    nh_local_.param("budget_bucket_scale", budget_bucket_scale_, 2.0);
+    nh_local_.param("budget_min_pyramid_level", budget_min_pyramid_level_, 1);
 
     for (fovis::VisualOdometryOptions::iterator iter = visual_odometer_options_.begin();
         iter != visual_odometer_options_.end();
@@ -315,17 +1364,50 @@ private:
     }
   }
 
+  /**
+   * Marks the cached base to sensor transform as outdated, called from
+   * the spinner thread whenever static transforms are (re-)published.
+   */
+  void tfStaticCallback(const tf2_msgs::TFMessageConstPtr& /*msg*/)
+  {
+    __sync_lock_test_and_set(&base_to_sensor_invalid_, 1);
+  }
+
+  /**
+   * Looks up the transform from base to sensor. If ~cache_base_to_sensor
+   * is set, the transform is treated as static and looked up only once,
+   * and again after /tf_static changed. Not thread safe, calls are made
+   * from one stage at a time.
+   */
   void getBaseToSensorTransform(const ros::Time& stamp, 
       const std::string& sensor_frame_id, tf::StampedTransform& base_to_sensor)
   {
+    if (cache_base_to_sensor_)
+    {
+      bool invalid = __sync_lock_test_and_set(&base_to_sensor_invalid_, 0);
+      if (base_to_sensor_cached_ && !invalid &&
+          sensor_frame_id == cached_sensor_frame_id_)
+      {
+        base_to_sensor = cached_base_to_sensor_;
+        return;
+      }
+      base_to_sensor_cached_ = false;
+    }
+
     std::string error_msg;
-    if (tf_listener_.canTransform(
+    if (tf_listener_->canTransform(
           base_link_frame_id_, sensor_frame_id, stamp, &error_msg))
     {
-      tf_listener_.lookupTransform(
+      tf_listener_->lookupTransform(
           base_link_frame_id_,
           sensor_frame_id,
           stamp, base_to_sensor);
+      if (cache_base_to_sensor_)
+      {
+        cached_base_to_sensor_ = base_to_sensor;
+        cached_sensor_frame_id_ = sensor_frame_id;
+        base_to_sensor_cached_ = true;
+      }
     }
     else
     {
@@ -338,6 +1420,19 @@ private:
     }
   }
 
+  void tfToEigen(const tf::Transform& transform, Eigen::Isometry3d& pose)
+  {
+    const tf::Matrix3x3& basis = transform.getBasis();
+    for (int i = 0; i < 3; ++i)
+    {
+      tf::Vector3 row = basis.getRow(i);
+      pose.linear().row(i) << row.x(), row.y(), row.z();
+    }
+    const tf::Vector3& origin = transform.getOrigin();
+    pose.translation() << origin.x(), origin.y(), origin.z();
+    pose.makeAffine();
+  }
+
   void eigenToTF(const Eigen::Isometry3d& pose, tf::Transform& transform)
   {
     tf::Vector3 origin(
@@ -354,22 +1449,118 @@ private:
   fovis::VisualOdometry* visual_odometer_;
   fovis::Rectification* rectification_;
   fovis::DepthSource* depth_source_;
+  const image_conversion::RemapTable* rectification_table_;
   fovis::VisualOdometryOptions visual_odometer_options_;
 
+  // the reported pose is pose_offset_ * the pose of visual_odometer_,
+  // which restarts from identity whenever the odometer is rebuilt
+  Eigen::Transform<double, 3, Eigen::Isometry, Eigen::DontAlign> pose_offset_;
+
+  // live option changes: the service callback starts a thread that
+  // builds the new odometer and hands it over through rebuilt_odometer_
+  struct RebuiltOdometer
+  {
+    fovis::VisualOdometry* visual_odometer;
+    fovis::Rectification* rectification;
+    fovis::DepthSource* depth_source;
+    fovis::VisualOdometryOptions options;
+    double feature_budget;
+    bool log;
+  };
+  boost::mutex rebuild_mutex_;
+  sensor_msgs::CameraInfoConstPtr camera_info_;
+  fovis::VisualOdometryOptions requested_options_;
+  bool rebuilding_;
+  boost::scoped_ptr<boost::thread> rebuild_thread_;
+  RebuiltOdometer* volatile rebuilt_odometer_;
+  ros::ServiceServer set_options_srv_;
+
+  // set by the ~reset service, taken by the odometry stage
+  volatile int reset_requested_;
+  ros::ServiceServer reset_srv_;
+
+  // feature budget controller, disabled if the target is 0:
+  // feature_budget_ is the latest budget, active_feature_budget_ that
+  // of the running odometer
+  double target_process_frame_time_;
+  double budget_pixels_per_feature_scale_;
+  double budget_bucket_scale_;
+  int budget_min_pyramid_level_;
+  double feature_budget_;
+  double active_feature_budget_;
+  // smoothed processFrame() time, frames since the last change and
+  // time of the last change
+  double budget_time_;
+  int budget_frames_;
+  ros::WallTime budget_change_time_;
+
   ros::Time last_time_;
 
+  // covariance of the sensor pose, see propagatePoseCovariance(), not
+  // aligned as odometers are allocated with plain new
+  Eigen::Matrix<double, 6, 6, Eigen::DontAlign> pose_cov_;
+
+  // pipelined mode: the subscriber callback converts frame N+1 while
+  // the odometry thread processes frame N and the output thread
+  // publishes frame N-1
+  static const int NUM_PIPELINE_FRAMES = 3;
+  static const int NUM_PIPELINE_RESULTS = 3;
+  bool pipelined_;
+  std::vector<Frame*> frames_;
+  std::vector<Result*> results_;
+  boost::scoped_ptr<SpscQueue<Frame*> > input_queue_;
+  boost::scoped_ptr<SpscQueue<Frame*> > free_frames_;
+  boost::scoped_ptr<SpscQueue<Result*> > output_queue_;
+  boost::scoped_ptr<SpscQueue<Result*> > free_results_;
+  boost::scoped_ptr<boost::thread> odometry_thread_;
+  boost::scoped_ptr<boost::thread> output_thread_;
+
+  // pool mode: frames are queued by the subscriber callback and
+  // processed by at most one task of the pool at a time
+  WorkStealingPool* pool_;
+  boost::mutex strand_mutex_;
+  boost::condition_variable strand_idle_;
+  // signalled whenever a frame is added to idle_frames_
+  boost::condition_variable frame_released_;
+  std::deque<Frame*> pending_frames_;
+  std::vector<Frame*> idle_frames_;
+  bool strand_scheduled_;
+  bool strand_stopped_;
+  int num_busy_drops_;
+
   // tf related
   std::string sensor_frame_id_;
   std::string odom_frame_id_;
   std::string base_link_frame_id_;
   bool publish_tf_;
   tf::StampedTransform initial_base_to_sensor_;
-  tf::TransformListener tf_listener_;
+  boost::shared_ptr<tf::TransformListener> tf_listener_;
   tf::TransformBroadcaster tf_broadcaster_;
+
+  // cache for a static base to sensor transform, failed lookups are
+  // not cached but repeated for the next frame
+  bool cache_base_to_sensor_;
+  bool base_to_sensor_cached_;
+  volatile int base_to_sensor_invalid_;
+  std::string cached_sensor_frame_id_;
+  tf::StampedTransform cached_base_to_sensor_;
+  ros::Subscriber tf_static_sub_;
+
+  // gyro input (~use_imu), integrated by the odometry stage between the
+  // stamps of consecutive frames. libfovis takes no motion prior, so it
+  // only bridges failed estimates and is reported in ~info, matching is
+  // not affected
+  bool use_imu_;
+  boost::scoped_ptr<GyroIntegrator> gyro_integrator_;
+  ros::Subscriber imu_sub_;
+  ros::Time last_frame_stamp_;
+  bool imu_to_sensor_known_;
+  Eigen::Quaternion<double, Eigen::DontAlign> imu_to_sensor_;
   
   // Messages
   nav_msgs::Odometry odom_msg_;
   geometry_msgs::PoseStamped pose_msg_;
+  sensor_msgs::PointCloud2 inlier_cloud_msg_;
 
   ros::NodeHandle nh_local_;
 
@@ -377,9 +1568,19 @@ private:
   ros::Publisher odom_pub_;
   ros::Publisher pose_pub_;
   ros::Publisher info_pub_;
+  ros::Publisher inlier_cloud_pub_;
   image_transport::Publisher features_pub_;
+  ros::Publisher feature_data_pub_;
   image_transport::ImageTransport it_;
+
+  // feature image rendering
+  double features_max_rate_;
+  double features_scale_;
+  boost::scoped_ptr<FeatureImageWorker> feature_image_worker_;
+  // scratch space for the feature data message, odometry stage only
+  visualization::Snapshot features_snapshot_;
 };
 
 } // end of namespace
 
+#endif
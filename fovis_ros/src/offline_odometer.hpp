@@ -0,0 +1,247 @@
+#ifndef OFFLINE_ODOMETER_H_
+#define OFFLINE_ODOMETER_H_
+
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <ros/ros.h>
+#include <sensor_msgs/Image.h>
+#include <sensor_msgs/CameraInfo.h>
+#include <sensor_msgs/image_encodings.h>
+#include <cv_bridge/cv_bridge.h>
+
+#include <fovis_ros/FovisInfo.h>
+
+#include <libfovis/visual_odometry.hpp>
+#include <libfovis/stereo_depth.hpp>
+#include <libfovis/depth_image.hpp>
+
+#include "odometer_base.hpp"
+#include "stereo_odometer.hpp"
+#include "mono_depth_odometer.hpp"
+#include "image_conversion.hpp"
+
+namespace fovis_ros
+{
+
+/**
+ * Runs fovis on input messages that are handed over directly, e.g. read
+ * from a bag file. Uses the same depth sources and conversions as the
+ * odometer nodes, but does not need a ROS master: there are no
+ * subscribers, publishers or tf lookups, the reported pose is the pose
+ * of the camera relative to its first pose.
+ */
+class OfflineOdometer
+{
+
+public:
+
+  explicit OfflineOdometer(const fovis::VisualOdometryOptions& options) :
+    options_(options),
+    visual_odometer_(NULL),
+    rectification_(NULL),
+    stereo_depth_(NULL),
+    stereo_calibration_(NULL),
+    depth_image_(NULL)
+  {
+  }
+
+  ~OfflineOdometer()
+  {
+    if (visual_odometer_) delete visual_odometer_;
+    if (rectification_) delete rectification_;
+    if (stereo_depth_) delete stereo_depth_;
+    if (stereo_calibration_) delete stereo_calibration_;
+    if (depth_image_) delete depth_image_;
+  }
+
+  /**
+   * Sets an option given as name and value, name may contain
+   * underscores instead of hyphens as for the ROS parameters.
+   * \return false if there is no such option
+   */
+  static bool setOption(fovis::VisualOdometryOptions& options,
+      const std::string& name, const std::string& value)
+  {
+    std::string key = name;
+    std::replace(key.begin(), key.end(), '_', '-');
+    if (options.find(key) == options.end()) return false;
+    options[key] = value;
+    return true;
+  }
+
+  /**
+   * Parses command line arguments of the form name:=value. Names that
+   * are keys of args replace the default value given there, all others
+   * have to be fovis options.
+   * \param first index of the first argument to parse
+   * \return false if an argument could not be parsed
+   */
+  static bool parseArguments(int argc, char** argv, int first,
+      std::map<std::string, std::string>& args,
+      fovis::VisualOdometryOptions& options)
+  {
+    for (int i = first; i < argc; ++i)
+    {
+      std::string arg = argv[i];
+      size_t pos = arg.find(":=");
+      if (pos == std::string::npos)
+      {
+        std::cerr << "Invalid argument '" << arg << "'" << std::endl;
+        return false;
+      }
+      std::string name = arg.substr(0, pos);
+      std::string value = arg.substr(pos + 2);
+      if (args.count(name))
+      {
+        args[name] = value;
+      }
+      else if (!setOption(options, name, value))
+      {
+        std::cerr << "Unknown argument '" << name << "'" << std::endl;
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /**
+   * Processes a rectified stereo pair.
+   * \return false if the input could not be processed
+   */
+  bool processStereo(
+      const sensor_msgs::ImageConstPtr& l_image_msg,
+      const sensor_msgs::ImageConstPtr& r_image_msg,
+      const sensor_msgs::CameraInfoConstPtr& l_info_msg,
+      const sensor_msgs::CameraInfoConstPtr& r_info_msg)
+  {
+    if (depth_image_) return false;
+    if (!stereo_depth_)
+    {
+      stereo_depth_ = StereoOdometer::createStereoDepth(
+          l_info_msg, r_info_msg, options_, stereo_calibration_);
+    }
+    if (l_image_msg->width != r_image_msg->width ||
+        l_image_msg->height != r_image_msg->height)
+      return false;
+
+    ros::WallTime start_time = ros::WallTime::now();
+    cv_bridge::CvImageConstPtr r_cv_image;
+    const uint8_t* r_image_data = OdometerBase::grayImageData(
+        *r_image_msg, r_image_buffer_, r_cv_image);
+    return processFrame(l_image_msg, l_info_msg, start_time,
+        stereo_depth_, r_image_data, NULL);
+  }
+
+  /**
+   * Processes a rectified image with its registered depth image.
+   * \return false if the input could not be processed
+   */
+  bool processMonoDepth(
+      const sensor_msgs::ImageConstPtr& image_msg,
+      const sensor_msgs::ImageConstPtr& depth_msg,
+      const sensor_msgs::CameraInfoConstPtr& image_info_msg,
+      const sensor_msgs::CameraInfoConstPtr& depth_info_msg)
+  {
+    if (stereo_depth_) return false;
+    if (!depth_image_)
+    {
+      depth_image_ = MonoDepthOdometer::createDepthSource(
+          image_info_msg, depth_info_msg);
+    }
+
+    ros::WallTime start_time = ros::WallTime::now();
+    const float* depth_data =
+      MonoDepthOdometer::metricDepthData(*depth_msg, depth_buffer_);
+    if (!depth_data) return false;
+    return processFrame(image_msg, image_info_msg, start_time,
+        depth_image_, NULL, depth_data);
+  }
+
+  /**
+   * Returns the odometer, NULL before the first frame has been processed.
+   */
+  const fovis::VisualOdometry* getOdometry() const
+  {
+    return visual_odometer_;
+  }
+
+  /**
+   * Returns the pose of the camera after the last processed frame
+   * relative to its first pose.
+   */
+  const Eigen::Isometry3d& getPose() const
+  {
+    return pose_;
+  }
+
+  /**
+   * Returns the statistics and timing of the last processed frame.
+   */
+  const FovisInfo& getInfo() const
+  {
+    return info_msg_;
+  }
+
+private:
+
+  bool processFrame(const sensor_msgs::ImageConstPtr& image_msg,
+      const sensor_msgs::CameraInfoConstPtr& info_msg,
+      const ros::WallTime& start_time, fovis::DepthSource* depth_source,
+      const uint8_t* right_image_data, const float* depth_data)
+  {
+    cv_bridge::CvImageConstPtr cv_image;
+    const uint8_t* image_data = OdometerBase::grayImageData(
+        *image_msg, image_buffer_, cv_image);
+    ros::WallTime stage_start = ros::WallTime::now();
+    info_msg_.conversion_time = (stage_start - start_time).toSec();
+
+    if (!visual_odometer_)
+    {
+      visual_odometer_ =
+        OdometerBase::createVisualOdometry(info_msg, options_, rectification_);
+    }
+
+    if (right_image_data) stereo_depth_->setRightImage(right_image_data);
+    if (depth_data) depth_image_->setDepthImage(depth_data);
+    ros::WallTime stage_end = ros::WallTime::now();
+    info_msg_.depth_update_time = (stage_end - stage_start).toSec();
+
+    stage_start = stage_end;
+    visual_odometer_->processFrame(image_data, depth_source);
+    stage_end = ros::WallTime::now();
+    info_msg_.process_frame_time = (stage_end - stage_start).toSec();
+
+    pose_ = visual_odometer_->getPose();
+    info_msg_.header = image_msg->header;
+    OdometerBase::fillInfo(visual_odometer_, info_msg_);
+    info_msg_.runtime = (stage_end - start_time).toSec();
+    return true;
+  }
+
+  fovis::VisualOdometryOptions options_;
+  fovis::VisualOdometry* visual_odometer_;
+  fovis::Rectification* rectification_;
+  fovis::StereoDepth* stereo_depth_;
+  fovis::StereoCalibration* stereo_calibration_;
+  fovis::DepthImage* depth_image_;
+
+  // buffers for packed or converted input, reused across frames
+  image_conversion::AlignedBuffer image_buffer_;
+  image_conversion::AlignedBuffer r_image_buffer_;
+  std::vector<float> depth_buffer_;
+
+  Eigen::Isometry3d pose_;
+  FovisInfo info_msg_;
+
+public:
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+} // end of namespace
+
+#endif
@@ -0,0 +1,161 @@
+#include <algorithm>
+#include <cmath>
+
+#include <libfovis/frame.hpp>
+#include <libfovis/feature_match.hpp>
+
+#include "point_cloud_depth_source.hpp"
+
+
+fovis_ros::ProjectedCloud::ProjectedCloud() :
+  width_(0), height_(0)
+{
+}
+
+void fovis_ros::ProjectedCloud::project(
+    const pcl::PointCloud<pcl::PointXYZ>& cloud,
+    const Eigen::Affine3f& cloud_to_camera,
+    const fovis::CameraIntrinsicsParameters& parameters)
+{
+  width_ = parameters.width;
+  height_ = parameters.height;
+  entries_.clear();
+  entries_.reserve(cloud.points.size());
+  const float fx = parameters.fx, fy = parameters.fy;
+  const float cx = parameters.cx, cy = parameters.cy;
+  for (size_t i = 0; i < cloud.points.size(); ++i)
+  {
+    const pcl::PointXYZ& p = cloud.points[i];
+    if (!pcl_isfinite(p.x) || !pcl_isfinite(p.y) || !pcl_isfinite(p.z))
+      continue;
+    Eigen::Vector3f xyz = cloud_to_camera * Eigen::Vector3f(p.x, p.y, p.z);
+    if (xyz.z() <= 0.0f)
+      continue;
+    // round to the nearest pixel and test the bounds before converting,
+    // casting would round towards zero and could overflow
+    const float uf = std::floor(fx * xyz.x() / xyz.z() + cx + 0.5f);
+    const float vf = std::floor(fy * xyz.y() / xyz.z() + cy + 0.5f);
+    if (!(uf >= 0.0f && vf >= 0.0f && uf < width_ && vf < height_))
+      continue;
+    const int u = static_cast<int>(uf);
+    const int v = static_cast<int>(vf);
+    Entry entry;
+    entry.pixel = v * width_ + u;
+    entry.depth = xyz.z();
+    entries_.push_back(entry);
+  }
+  // sorting puts the closest point of each pixel first,
+  // unique then removes the occluded ones
+  std::sort(entries_.begin(), entries_.end());
+  entries_.erase(std::unique(entries_.begin(), entries_.end(), samePixel),
+      entries_.end());
+}
+
+bool fovis_ros::ProjectedCloud::lookup(double u, double v, int radius,
+    float& depth) const
+{
+  int ui = static_cast<int>(std::floor(u + 0.5));
+  int vi = static_cast<int>(std::floor(v + 0.5));
+  int best_distance = -1;
+  Entry key;
+  key.depth = -1.0f;
+  for (int row = std::max(vi - radius, 0);
+       row <= std::min(vi + radius, height_ - 1); ++row)
+  {
+    int first = std::max(ui - radius, 0);
+    int last = std::min(ui + radius, width_ - 1);
+    key.pixel = row * width_ + first;
+    std::vector<Entry>::const_iterator it =
+      std::lower_bound(entries_.begin(), entries_.end(), key);
+    for (; it != entries_.end() && it->pixel <= row * width_ + last; ++it)
+    {
+      int du = it->pixel - row * width_ - ui;
+      int dv = row - vi;
+      int distance = du * du + dv * dv;
+      if (best_distance < 0 || distance < best_distance)
+      {
+        best_distance = distance;
+        depth = it->depth;
+      }
+    }
+  }
+  return best_distance >= 0;
+}
+
+fovis_ros::PointCloudDepthSource::PointCloudDepthSource(
+    const fovis::CameraIntrinsicsParameters& parameters, int search_radius) :
+  parameters_(parameters),
+  search_radius_(search_radius),
+  cloud_(NULL)
+{
+}
+
+void fovis_ros::PointCloudDepthSource::setProjectedCloud(
+    const ProjectedCloud* cloud)
+{
+  cloud_ = cloud;
+}
+
+bool fovis_ros::PointCloudDepthSource::haveXyz(int u, int v)
+{
+  float depth;
+  return cloud_->lookup(u, v, search_radius_, depth);
+}
+
+void fovis_ros::PointCloudDepthSource::getXyz(fovis::OdometryFrame* frame)
+{
+  for (int level_num = 0; level_num < frame->getNumLevels(); ++level_num)
+  {
+    fovis::PyramidLevel* level = frame->getLevel(level_num);
+    for (int kp_ind = 0; kp_ind < level->getNumKeypoints(); ++kp_ind)
+    {
+      fovis::KeypointData* kp_data = level->getKeypointData(kp_ind);
+      if (!getXyz(kp_data->rect_base_uv(0), kp_data->rect_base_uv(1), kp_data))
+      {
+        kp_data->has_depth = false;
+        kp_data->disparity = NAN;
+        kp_data->xyz = Eigen::Vector3d(NAN, NAN, NAN);
+        kp_data->xyzw = Eigen::Vector4d(NAN, NAN, NAN, NAN);
+      }
+    }
+  }
+}
+
+void fovis_ros::PointCloudDepthSource::refineXyz(fovis::FeatureMatch* matches,
+    int num_matches, fovis::OdometryFrame* frame)
+{
+  for (int m_ind = 0; m_ind < num_matches; ++m_ind)
+  {
+    fovis::FeatureMatch& match = matches[m_ind];
+    if (match.status != fovis::MATCH_NEEDS_DEPTH_REFINEMENT)
+      continue;
+    fovis::KeypointData* kp_data = &match.refined_target_keypoint;
+    if (getXyz(kp_data->rect_base_uv(0), kp_data->rect_base_uv(1), kp_data))
+    {
+      match.status = fovis::MATCH_OK;
+    }
+    else
+    {
+      match.status = fovis::MATCH_REFINEMENT_FAILED;
+      match.inlier = false;
+    }
+  }
+}
+
+bool fovis_ros::PointCloudDepthSource::getXyz(double u, double v,
+    fovis::KeypointData* kp_data) const
+{
+  float depth;
+  if (!cloud_->lookup(u, v, search_radius_, depth))
+    return false;
+  // the depth of the point is assigned to the ray through the keypoint
+  kp_data->has_depth = true;
+  kp_data->disparity = NAN;
+  kp_data->xyz = Eigen::Vector3d((u - parameters_.cx) * depth / parameters_.fx,
+                                 (v - parameters_.cy) * depth / parameters_.fy,
+                                 depth);
+  kp_data->xyzw.head<3>() = kp_data->xyz;
+  kp_data->xyzw.w() = 1;
+  return true;
+}
+
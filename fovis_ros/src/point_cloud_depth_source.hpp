@@ -0,0 +1,126 @@
+#ifndef POINT_CLOUD_DEPTH_SOURCE_H_
+#define POINT_CLOUD_DEPTH_SOURCE_H_
+
+#include <vector>
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+#include <libfovis/depth_source.hpp>
+#include <libfovis/camera_intrinsics.hpp>
+
+namespace fovis_ros
+{
+
+/**
+ * Sparse depth image built from a point cloud (e.g. of a LiDAR): the
+ * depths of all points that project into the image, sorted by pixel
+ * index. Only the closest point is kept per pixel.
+ */
+class ProjectedCloud
+{
+
+public:
+
+  ProjectedCloud();
+
+  /**
+   * Projects cloud into the image described by parameters, replacing
+   * the previous content. Memory is reused across calls.
+   * \param cloud_to_camera transform from the cloud frame to the
+   *        optical frame of the camera
+   */
+  void project(const pcl::PointCloud<pcl::PointXYZ>& cloud,
+      const Eigen::Affine3f& cloud_to_camera,
+      const fovis::CameraIntrinsicsParameters& parameters);
+
+  /**
+   * Looks for the point that is closest to (u, v) in the image within
+   * a square window of the given radius.
+   * \return false if there is no point in the window
+   */
+  bool lookup(double u, double v, int radius, float& depth) const;
+
+  size_t size() const
+  {
+    return entries_.size();
+  }
+
+private:
+
+  struct Entry
+  {
+    int pixel;
+    float depth;
+
+    bool operator<(const Entry& other) const
+    {
+      return pixel < other.pixel ||
+        (pixel == other.pixel && depth < other.depth);
+    }
+  };
+
+  static bool samePixel(const Entry& a, const Entry& b)
+  {
+    return a.pixel == b.pixel;
+  }
+
+  std::vector<Entry> entries_;
+  int width_;
+  int height_;
+};
+
+/**
+ * Depth source that serves keypoint depth from a ProjectedCloud, so
+ * fovis can run on a mono camera together with a LiDAR without creating
+ * a dense depth image.
+ */
+class PointCloudDepthSource : public fovis::DepthSource
+{
+
+public:
+
+  /**
+   * \param parameters intrinsics of the rectified camera
+   * \param search_radius radius in pixels around a keypoint that is
+   *        searched for a projected point
+   */
+  PointCloudDepthSource(const fovis::CameraIntrinsicsParameters& parameters,
+      int search_radius);
+
+  const fovis::CameraIntrinsicsParameters& getParameters() const
+  {
+    return parameters_;
+  }
+
+  /**
+   * Sets the projected cloud for the next frame. It is not copied and
+   * has to stay valid until the frame has been processed.
+   */
+  void setProjectedCloud(const ProjectedCloud* cloud);
+
+  virtual bool haveXyz(int u, int v);
+
+  virtual void getXyz(fovis::OdometryFrame* frame);
+
+  virtual void refineXyz(fovis::FeatureMatch* matches, int num_matches,
+      fovis::OdometryFrame* frame);
+
+  virtual double getBaseline() const
+  {
+    return 0;
+  }
+
+private:
+
+  bool getXyz(double u, double v, fovis::KeypointData* kp_data) const;
+
+  fovis::CameraIntrinsicsParameters parameters_;
+  int search_radius_;
+  const ProjectedCloud* cloud_;
+};
+
+} // end of namespace
+
+#endif
+
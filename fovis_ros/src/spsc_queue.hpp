@@ -0,0 +1,170 @@
+#ifndef SPSC_QUEUE_H_
+#define SPSC_QUEUE_H_
+
+#include <vector>
+
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+namespace fovis_ros
+{
+
+/**
+ * Bounded queue for exactly one producer and one consumer thread.
+ * Pushing and popping is lock-free, a thread only takes the mutex to go
+ * to sleep if the queue is full (push) or empty (pop) and to wake up the
+ * other side if it is sleeping.
+ */
+template<typename T>
+class SpscQueue
+{
+
+public:
+
+  explicit SpscQueue(size_t capacity) :
+    buffer_(capacity + 1), head_(0), tail_(0), sleepers_(0), closed_(false)
+  {
+  }
+
+  /**
+   * Appends item to the queue, blocks while the queue is full.
+   * \return false if the queue has been closed
+   */
+  bool push(const T& item)
+  {
+    while (!tryPush(item))
+    {
+      boost::unique_lock<boost::mutex> lock(mutex_);
+      __sync_fetch_and_add(&sleepers_, 1);
+      while (!closed_ && full())
+        condition_.wait(lock);
+      __sync_fetch_and_sub(&sleepers_, 1);
+      if (closed_)
+        return false;
+    }
+    wakeUp();
+    return true;
+  }
+
+  /**
+   * Removes the oldest item from the queue, blocks while the queue is
+   * empty.
+   * \return false if the queue has been closed and is empty
+   */
+  bool pop(T& item)
+  {
+    while (!tryPop(item))
+    {
+      boost::unique_lock<boost::mutex> lock(mutex_);
+      __sync_fetch_and_add(&sleepers_, 1);
+      while (!closed_ && empty())
+        condition_.wait(lock);
+      __sync_fetch_and_sub(&sleepers_, 1);
+      if (closed_ && empty())
+        return false;
+    }
+    wakeUp();
+    return true;
+  }
+
+  /**
+   * Non-blocking version of push().
+   * \return false if the queue is full or closed
+   */
+  bool tryPush(const T& item)
+  {
+    if (closed_)
+      return false;
+    size_t tail = tail_;
+    size_t next = increment(tail);
+    if (next == load(head_))
+      return false;
+    buffer_[tail] = item;
+    store(tail_, next);
+    return true;
+  }
+
+  /**
+   * Non-blocking version of pop().
+   * \return false if the queue is empty
+   */
+  bool tryPop(T& item)
+  {
+    size_t head = head_;
+    if (head == load(tail_))
+      return false;
+    item = buffer_[head];
+    store(head_, increment(head));
+    return true;
+  }
+
+  /**
+   * Wakes up all waiting threads and makes subsequent pushes fail.
+   * Items already in the queue can still be popped.
+   */
+  void close()
+  {
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    closed_ = true;
+    __sync_synchronize();
+    condition_.notify_all();
+  }
+
+  bool empty() const
+  {
+    return load(head_) == load(tail_);
+  }
+
+  bool full() const
+  {
+    return increment(load(tail_)) == load(head_);
+  }
+
+private:
+
+  size_t increment(size_t index) const
+  {
+    return (index + 1) % buffer_.size();
+  }
+
+  // index accesses with acquire/release semantics across threads
+  static size_t load(const volatile size_t& index)
+  {
+    size_t value = index;
+    __sync_synchronize();
+    return value;
+  }
+
+  static void store(volatile size_t& index, size_t value)
+  {
+    __sync_synchronize();
+    index = value;
+  }
+
+  void wakeUp()
+  {
+    // pairs with the increment of sleepers_ before the waiting thread
+    // checks the queue state, so a wake up cannot get lost
+    __sync_synchronize();
+    if (sleepers_ > 0)
+    {
+      boost::lock_guard<boost::mutex> lock(mutex_);
+      condition_.notify_all();
+    }
+  }
+
+  std::vector<T> buffer_;
+  volatile size_t head_;
+  volatile size_t tail_;
+
+  volatile int sleepers_;
+  volatile bool closed_;
+  boost::mutex mutex_;
+  boost::condition_variable condition_;
+};
+
+} // end of namespace
+
+#endif
+
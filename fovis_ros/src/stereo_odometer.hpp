@@ -0,0 +1,227 @@
+#ifndef STEREO_ODOMETER_H_
+#define STEREO_ODOMETER_H_
+
+#include <ros/ros.h>
+#include <sensor_msgs/image_encodings.h>
+#include <image_geometry/stereo_camera_model.h>
+#include <cv_bridge/cv_bridge.h>
+
+#include <fovis_ros/FovisInfo.h>
+
+#include <libfovis/stereo_depth.hpp>
+#include <libfovis/stereo_calibration.hpp>
+
+#include "stereo_processor.hpp"
+#include "odometer_base.hpp"
+#include "visualization.hpp"
+#include "image_conversion.hpp"
+
+namespace fovis_ros
+{
+
+class StereoOdometer : public StereoProcessor, OdometerBase
+{
+
+private:
+
+  fovis::StereoDepth* stereo_depth_;
+  fovis::StereoCalibration* stereo_calibration_;
+  // calibration of a depth source created by the rebuild thread
+  fovis::StereoCalibration* rebuilt_calibration_;
+  // camera infos the depth source has been created for
+  sensor_msgs::CameraInfoConstPtr l_info_msg_;
+  sensor_msgs::CameraInfoConstPtr r_info_msg_;
+
+  // in-node rectification of raw images
+  bool rectify_;
+  image_conversion::RemapTable l_rectification_table_;
+  image_conversion::RemapTable r_rectification_table_;
+
+  struct StereoFrame : public Frame
+  {
+    // keep the right image and its conversion by cv_bridge alive if they
+    // are used without a copy
+    sensor_msgs::ImageConstPtr r_image_msg;
+    cv_bridge::CvImageConstPtr r_cv_image;
+    const uint8_t* r_image_data;
+    // gray right image, used for padded or non-gray input
+    image_conversion::AlignedBuffer r_image_buffer;
+    // rectified right image, only used with ~rectify
+    std::vector<uint8_t> r_rectified_buffer;
+  };
+
+public:
+
+  /**
+   * \param tf_listener see OdometerBase
+   * \param pool see OdometerBase
+   */
+  StereoOdometer(const ros::NodeHandle& nh, const ros::NodeHandle& local_nh,
+      const std::string& transport,
+      const boost::shared_ptr<tf::TransformListener>& tf_listener =
+        boost::shared_ptr<tf::TransformListener>(),
+      WorkStealingPool* pool = NULL) :
+    StereoProcessor(nh, local_nh, transport),
+    OdometerBase(local_nh, tf_listener, pool),
+    stereo_depth_(NULL),
+    stereo_calibration_(NULL),
+    rebuilt_calibration_(NULL)
+  {
+    local_nh.param("rectify", rectify_, false);
+    subscribe();
+  }
+
+  ~StereoOdometer()
+  {
+    unsubscribe();
+    stopPipeline();
+    if (stereo_depth_) delete stereo_depth_;
+    if (stereo_calibration_) delete stereo_calibration_;
+    if (rebuilt_calibration_) delete rebuilt_calibration_;
+  }
+
+  /**
+   * Creates the depth source for a rectified stereo pair. Does not need
+   * a connection to a ROS master.
+   * \param calibration set to the calibration of the depth source, which
+   *        only references it: the caller has to delete it after the
+   *        depth source
+   */
+  static fovis::StereoDepth* createStereoDepth(
+      const sensor_msgs::CameraInfoConstPtr& l_info_msg,
+      const sensor_msgs::CameraInfoConstPtr& r_info_msg,
+      const fovis::VisualOdometryOptions& options,
+      fovis::StereoCalibration*& calibration)
+  {
+    // read calibration info from camera info message
+    // to fill remaining parameters
+    image_geometry::StereoCameraModel model;
+    model.fromCameraInfo(*l_info_msg, *r_info_msg);
+
+    // initialize left camera parameters
+    fovis::CameraIntrinsicsParameters left_parameters;
+    rosToFovis(model.left(), left_parameters);
+    left_parameters.height = l_info_msg->height;
+    left_parameters.width = l_info_msg->width;
+    // initialize right camera parameters
+    fovis::CameraIntrinsicsParameters right_parameters;
+    rosToFovis(model.right(), right_parameters);
+    right_parameters.height = r_info_msg->height;
+    right_parameters.width = r_info_msg->width;
+
+    // as we use rectified images, rotation is identity
+    // and translation is baseline only
+    fovis::StereoCalibrationParameters stereo_parameters;
+    stereo_parameters.left_parameters = left_parameters;
+    stereo_parameters.right_parameters = right_parameters;
+    stereo_parameters.right_to_left_rotation[0] = 1.0;
+    stereo_parameters.right_to_left_rotation[1] = 0.0;
+    stereo_parameters.right_to_left_rotation[2] = 0.0;
+    stereo_parameters.right_to_left_rotation[3] = 0.0;
+    stereo_parameters.right_to_left_translation[0] = -model.baseline();
+    stereo_parameters.right_to_left_translation[1] = 0.0;
+    stereo_parameters.right_to_left_translation[2] = 0.0;
+
+    calibration = new fovis::StereoCalibration(stereo_parameters);
+
+    return new fovis::StereoDepth(calibration, options);
+  }
+
+protected:
+
+  void imageCallback(
+      const sensor_msgs::ImageConstPtr& l_image_msg,
+      const sensor_msgs::ImageConstPtr& r_image_msg,
+      const sensor_msgs::CameraInfoConstPtr& l_info_msg,
+      const sensor_msgs::CameraInfoConstPtr& r_info_msg)
+  {
+    // stereo_depth_ belongs to the odometry stage once frames are
+    // processed, the camera infos tell whether it has been created
+    if (!l_info_msg_)
+    {
+      l_info_msg_ = l_info_msg;
+      r_info_msg_ = r_info_msg;
+      stereo_depth_ = createStereoDepth(l_info_msg, r_info_msg, getOptions(),
+          stereo_calibration_);
+      setDepthSource(stereo_depth_);
+      if (rectify_)
+      {
+        // the tables are built once, rectification is repeated per frame
+        createRectificationTable(*l_info_msg, l_rectification_table_);
+        createRectificationTable(*r_info_msg, r_rectification_table_);
+        setRectificationTable(&l_rectification_table_);
+      }
+    }
+    ROS_ASSERT(l_image_msg->width == r_image_msg->width);
+    ROS_ASSERT(l_image_msg->height == r_image_msg->height);
+    // the tables are only valid for the size of the first images, remapping
+    // other sizes would read outside of them
+    if (rectify_ &&
+        (static_cast<int>(l_image_msg->width) != l_rectification_table_.src_width ||
+         static_cast<int>(l_image_msg->height) != l_rectification_table_.src_height ||
+         static_cast<int>(r_image_msg->width) != r_rectification_table_.src_width ||
+         static_cast<int>(r_image_msg->height) != r_rectification_table_.src_height))
+    {
+      ROS_ERROR_THROTTLE(10.0, "Image size %ux%u differs from the size %dx%d "
+                               "the rectification was built for, dropping input!",
+                               l_image_msg->width, l_image_msg->height,
+                               l_rectification_table_.src_width,
+                               l_rectification_table_.src_height);
+      return;
+    }
+
+    StereoFrame* frame = static_cast<StereoFrame*>(acquireFrame());
+    if (!frame) return;
+    frame->num_dropped_inputs = getNumDroppedInputs();
+
+    // libfovis needs packed gray images, convert or repack if necessary
+    frame->r_image_msg = r_image_msg;
+    frame->r_image_data =
+      grayImageData(*r_image_msg, frame->r_image_buffer, frame->r_cv_image);
+    if (rectify_)
+    {
+      frame->r_rectified_buffer.resize(
+          r_rectification_table_.width * r_rectification_table_.height);
+      image_conversion::remap(frame->r_image_data, r_rectification_table_,
+          frame->r_rectified_buffer.data());
+      frame->r_image_data = frame->r_rectified_buffer.data();
+    }
+
+    // call base implementation
+    process(frame, l_image_msg, l_info_msg);
+  }
+
+  Frame* createFrame() const
+  {
+    return new StereoFrame();
+  }
+
+  void updateDepthSource(const Frame& frame)
+  {
+    // pass image to depth source
+    stereo_depth_->setRightImage(
+        static_cast<const StereoFrame&>(frame).r_image_data);
+  }
+
+  fovis::DepthSource* rebuildDepthSource(
+      const fovis::VisualOdometryOptions& options)
+  {
+    // handed over to replaceDepthSource() together with the depth source
+    return createStereoDepth(l_info_msg_, r_info_msg_, options,
+        rebuilt_calibration_);
+  }
+
+  void replaceDepthSource(fovis::DepthSource* depth_source)
+  {
+    delete stereo_depth_;
+    delete stereo_calibration_;
+    stereo_depth_ = static_cast<fovis::StereoDepth*>(depth_source);
+    stereo_calibration_ = rebuilt_calibration_;
+    rebuilt_calibration_ = NULL;
+    setDepthSource(stereo_depth_);
+  }
+};
+
+} // end of namespace
+
+#endif
@@ -0,0 +1,34 @@
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
+#include <boost/scoped_ptr.hpp>
+
+#include "stereo_odometer.hpp"
+
+namespace fovis_ros
+{
+
+/**
+ * Nodelet version of the stereo odometer. Running it in the same
+ * manager as the camera driver avoids serialization and copies of
+ * the incoming images.
+ */
+class StereoOdometerNodelet : public nodelet::Nodelet
+{
+
+private:
+
+  boost::scoped_ptr<StereoOdometer> odometer_;
+
+  virtual void onInit()
+  {
+    std::string transport;
+    getPrivateNodeHandle().param("transport", transport, std::string("raw"));
+    odometer_.reset(new StereoOdometer(
+          getNodeHandle(), getPrivateNodeHandle(), transport));
+  }
+};
+
+} // end of namespace
+
+PLUGINLIB_EXPORT_CLASS(fovis_ros::StereoOdometerNodelet, nodelet::Nodelet)
+
@@ -11,6 +11,8 @@
 #include <message_filters/sync_policies/approximate_time.h>
 #include <image_transport/subscriber_filter.h>
 
+#include "input_age_filter.hpp"
+
 namespace fovis_ros
 {
 
@@ -25,6 +27,10 @@ class StereoProcessor
 
 private:
 
+  ros::NodeHandle nh_;
+  ros::NodeHandle local_nh_;
+  std::string transport_;
+
   // subscriber
   image_transport::SubscriberFilter left_sub_, right_sub_;
   message_filters::Subscriber<sensor_msgs::CameraInfo> left_info_sub_, right_info_sub_;
@@ -35,6 +41,10 @@ private:
   boost::shared_ptr<ExactSync> exact_sync_;
   boost::shared_ptr<ApproximateSync> approximate_sync_;
   int queue_size_;
+  bool approximate_sync_enabled_;
+
+  // latency budget, older tuples are dropped
+  InputAgeFilter input_age_filter_;
 
   // for sync checking
   ros::WallTimer check_synced_timer_;
@@ -55,6 +65,9 @@ private:
     // For sync error checking
     ++all_received_; 
 
+    // drop tuples that cannot be processed within the latency budget
+    if (!input_age_filter_.accept(l_image_msg->header.stamp)) return;
+
     // call implementation
     imageCallback(l_image_msg, r_image_msg, l_info_msg, r_info_msg);
   }
@@ -89,21 +102,34 @@ private:
 protected:
 
   /**
-   * Constructor, subscribes to input topics using image transport and registers
-   * callbacks.
+   * Constructor, reads parameters. Input topics are not subscribed before
+   * subscribe() is called, which has to be done by the implementing class
+   * once it is fully constructed.
+   * \param nh Node handle used to resolve and subscribe to input topics
+   * \param local_nh Private node handle used to read parameters
    * \param transport The image transport to use
    */
-  StereoProcessor(const std::string& transport) :
+  StereoProcessor(const ros::NodeHandle& nh, const ros::NodeHandle& local_nh,
+      const std::string& transport) :
+    nh_(nh), local_nh_(local_nh), transport_(transport), input_age_filter_(local_nh),
     left_received_(0), right_received_(0), left_info_received_(0), right_info_received_(0), all_received_(0)
   {
     // Read local parameters
-    ros::NodeHandle local_nh("~");
+    local_nh_.param("queue_size", queue_size_, 5);
+    local_nh_.param("approximate_sync", approximate_sync_enabled_, false);
+  }
 
+  /**
+   * Subscribes to input topics using image transport and registers
+   * callbacks. Callbacks may be called as soon as this method returns
+   * (e.g. from a nodelet manager's worker threads).
+   */
+  void subscribe()
+  {
     // Resolve topic names
-    ros::NodeHandle nh;
-    std::string stereo_ns = nh.resolveName("stereo");
-    std::string left_topic = ros::names::clean(stereo_ns + "/left/" + nh.resolveName("image"));
-    std::string right_topic = ros::names::clean(stereo_ns + "/right/" + nh.resolveName("image"));
+    std::string stereo_ns = nh_.resolveName("stereo");
+    std::string left_topic = ros::names::clean(stereo_ns + "/left/" + nh_.resolveName("image"));
+    std::string right_topic = ros::names::clean(stereo_ns + "/right/" + nh_.resolveName("image"));
 
     std::string left_info_topic = stereo_ns + "/left/camera_info";
     std::string right_info_topic = stereo_ns + "/right/camera_info";
@@ -113,25 +139,22 @@ protected:
         left_topic.c_str(), right_topic.c_str(),
         left_info_topic.c_str(), right_info_topic.c_str());
 
-    image_transport::ImageTransport it(nh);
-    left_sub_.subscribe(it, left_topic, 1, transport);
-    right_sub_.subscribe(it, right_topic, 1, transport);
-    left_info_sub_.subscribe(nh, left_info_topic, 1);
-    right_info_sub_.subscribe(nh, right_info_topic, 1);
+    image_transport::ImageTransport it(nh_);
+    left_sub_.subscribe(it, left_topic, 1, transport_);
+    right_sub_.subscribe(it, right_topic, 1, transport_);
+    left_info_sub_.subscribe(nh_, left_info_topic, 1);
+    right_info_sub_.subscribe(nh_, right_info_topic, 1);
 
     // Complain every 15s if the topics appear unsynchronized
     left_sub_.registerCallback(boost::bind(StereoProcessor::increment, &left_received_));
     right_sub_.registerCallback(boost::bind(StereoProcessor::increment, &right_received_));
     left_info_sub_.registerCallback(boost::bind(StereoProcessor::increment, &left_info_received_));
     right_info_sub_.registerCallback(boost::bind(StereoProcessor::increment, &right_info_received_));
-    check_synced_timer_ = nh.createWallTimer(ros::WallDuration(15.0),
-                                             boost::bind(&StereoProcessor::checkInputsSynchronized, this));
+    check_synced_timer_ = nh_.createWallTimer(ros::WallDuration(15.0),
+                                              boost::bind(&StereoProcessor::checkInputsSynchronized, this));
 
     // Synchronize input topics. Optionally do approximate synchronization.
-    local_nh.param("queue_size", queue_size_, 5);
-    bool approx;
-    local_nh.param("approximate_sync", approx, false);
-    if (approx)
+    if (approximate_sync_enabled_)
     {
       approximate_sync_.reset(new ApproximateSync(ApproximatePolicy(queue_size_),
                                                   left_sub_, right_sub_, left_info_sub_, right_info_sub_) );
@@ -145,6 +168,32 @@ protected:
     }
   }
 
+  /**
+   * Shuts down the subscriptions, once this returns no callback is
+   * running or will be called. Implementing classes have to call this
+   * first thing in their destructor, as the processor is destroyed
+   * after them.
+   */
+  void unsubscribe()
+  {
+    check_synced_timer_.stop();
+    left_sub_.unsubscribe();
+    right_sub_.unsubscribe();
+    left_info_sub_.unsubscribe();
+    right_info_sub_.unsubscribe();
+    exact_sync_.reset();
+    approximate_sync_.reset();
+  }
+
+  /**
+   * Returns the number of synchronized input tuples that have been
+   * dropped because they were older than ~max_input_age.
+   */
+  int getNumDroppedInputs() const
+  {
+    return input_age_filter_.numDropped();
+  }
+
   /**
    * Implement this method in sub-classes 
    */
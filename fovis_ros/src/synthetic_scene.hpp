@@ -0,0 +1,214 @@
+#ifndef SYNTHETIC_SCENE_H_
+#define SYNTHETIC_SCENE_H_
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include <stdint.h>
+
+#include <Eigen/Geometry>
+
+namespace fovis_ros
+{
+
+/**
+ * Procedurally textured scene made of axis aligned boxes that can be
+ * rendered from arbitrary camera poses by ray casting, together with a
+ * scripted camera trajectory. Used to benchmark the odometers without
+ * any dataset.
+ */
+class SyntheticScene
+{
+
+public:
+
+  enum Type
+  {
+    PLANAR, ///< a single textured wall in front of the camera
+    BOXY    ///< a room with floor, walls and some boxes
+  };
+
+  /**
+   * Intrinsics of a pinhole camera, the camera frame is an optical
+   * frame (x right, y down, z forward).
+   */
+  struct Camera
+  {
+    int width;
+    int height;
+    double fx, fy, cx, cy;
+  };
+
+  explicit SyntheticScene(Type type)
+  {
+    if (type == PLANAR)
+    {
+      addBox(-20.0, -20.0, 4.0, 20.0, 20.0, 4.2);
+    }
+    else
+    {
+      // floor, ceiling and walls (y is pointing down)
+      addBox(-5.0, 1.5, -5.0, 5.0, 1.7, 8.0);
+      addBox(-5.0, -2.7, -5.0, 5.0, -2.5, 8.0);
+      addBox(-5.2, -2.5, -5.0, -5.0, 1.5, 8.0);
+      addBox(5.0, -2.5, -5.0, 5.2, 1.5, 8.0);
+      addBox(-5.0, -2.5, 8.0, 5.0, 1.5, 8.2);
+      // boxes standing on the floor
+      addBox(-2.5, 0.5, 3.0, -1.5, 1.5, 4.0);
+      addBox(0.5, -0.5, 4.5, 2.0, 1.5, 5.5);
+      addBox(-1.0, 1.0, 2.5, 0.0, 1.5, 3.0);
+      addBox(2.5, 0.0, 2.0, 3.5, 1.5, 3.0);
+      addBox(-4.0, -1.0, 5.5, -3.0, 1.5, 7.0);
+    }
+  }
+
+  /**
+   * Pose of the camera (camera to world) at time t of the scripted
+   * trajectory, a smooth motion in all six degrees of freedom.
+   */
+  static Eigen::Isometry3d trajectory(double t)
+  {
+    Eigen::Isometry3d pose = Eigen::Isometry3d::Identity();
+    pose.translation() = Eigen::Vector3d(
+        0.5 * std::sin(0.4 * t), 0.1 * std::sin(0.7 * t),
+        0.8 * std::sin(0.25 * t));
+    pose.linear() = (
+        Eigen::AngleAxisd(0.15 * std::sin(0.3 * t), Eigen::Vector3d::UnitY()) *
+        Eigen::AngleAxisd(0.05 * std::sin(0.5 * t), Eigen::Vector3d::UnitX()) *
+        Eigen::AngleAxisd(0.03 * std::sin(0.2 * t), Eigen::Vector3d::UnitZ())
+      ).toRotationMatrix();
+    return pose;
+  }
+
+  /**
+   * Renders the scene as seen from camera_pose.
+   * \param image packed 8 bit gray image of width*height pixels
+   * \param depth packed depth image (distance along z in metres) of
+   *        width*height pixels, may be NULL
+   */
+  void render(const Eigen::Isometry3d& camera_pose, const Camera& camera,
+      uint8_t* image, float* depth) const
+  {
+    const Eigen::Vector3d origin = camera_pose.translation();
+    const Eigen::Matrix3d rotation = camera_pose.linear();
+    // 2x2 supersampling against aliasing of the texture
+    static const double offsets[4][2] = {
+      {-0.25, -0.25}, {0.25, -0.25}, {-0.25, 0.25}, {0.25, 0.25}};
+    for (int v = 0; v < camera.height; ++v)
+    {
+      for (int u = 0; u < camera.width; ++u)
+      {
+        double intensity = 0.0;
+        for (int s = 0; s < 4; ++s)
+        {
+          Eigen::Vector3d ray(
+              (u + offsets[s][0] - camera.cx) / camera.fx,
+              (v + offsets[s][1] - camera.cy) / camera.fy, 1.0);
+          double distance;
+          intensity += shade(origin, rotation * ray, distance);
+        }
+        image[v * camera.width + u] = static_cast<uint8_t>(intensity / 4.0);
+        if (depth)
+        {
+          Eigen::Vector3d ray((u - camera.cx) / camera.fx,
+              (v - camera.cy) / camera.fy, 1.0);
+          double distance;
+          shade(origin, rotation * ray, distance);
+          // the ray has unit z, so the distance along it is the depth
+          depth[v * camera.width + u] = distance < noHit() ?
+            static_cast<float>(distance) :
+            std::numeric_limits<float>::quiet_NaN();
+        }
+      }
+    }
+  }
+
+private:
+
+  // distance reported for rays that do not hit anything
+  static double noHit()
+  {
+    return 1.0e9;
+  }
+
+  struct Box
+  {
+    Eigen::Vector3d min;
+    Eigen::Vector3d max;
+  };
+
+  void addBox(double x0, double y0, double z0, double x1, double y1, double z1)
+  {
+    Box box;
+    box.min = Eigen::Vector3d(x0, y0, z0);
+    box.max = Eigen::Vector3d(x1, y1, z1);
+    boxes_.push_back(box);
+  }
+
+  /**
+   * Casts a ray and returns the intensity of the closest hit, distance
+   * is given in multiples of direction.
+   */
+  double shade(const Eigen::Vector3d& origin, const Eigen::Vector3d& direction,
+      double& distance) const
+  {
+    distance = noHit();
+    int hit_box = -1, hit_axis = 0;
+    for (size_t i = 0; i < boxes_.size(); ++i)
+    {
+      // slab intersection
+      double t_near = -noHit(), t_far = noHit();
+      int near_axis = 0;
+      for (int axis = 0; axis < 3; ++axis)
+      {
+        double t0 = (boxes_[i].min[axis] - origin[axis]) / direction[axis];
+        double t1 = (boxes_[i].max[axis] - origin[axis]) / direction[axis];
+        if (t0 > t1) std::swap(t0, t1);
+        if (t0 > t_near)
+        {
+          t_near = t0;
+          near_axis = axis;
+        }
+        t_far = std::min(t_far, t1);
+      }
+      if (t_near <= t_far && t_near > 0.0 && t_near < distance)
+      {
+        distance = t_near;
+        hit_box = i;
+        hit_axis = near_axis;
+      }
+    }
+    if (hit_box < 0) return 0.0;
+
+    // texture coordinates are the two coordinates in the face plane
+    Eigen::Vector3d point = origin + distance * direction;
+    double s = point[(hit_axis + 1) % 3];
+    double t = point[(hit_axis + 2) % 3];
+    uint32_t face = hit_box * 3 + hit_axis;
+    return 0.55 * tile(s, t, 0.05, face) + 0.45 * tile(s, t, 0.2, face + 1000);
+  }
+
+  /**
+   * Random gray value that is constant on squares of the given size,
+   * the edges and corners of the squares give good features.
+   */
+  static double tile(double s, double t, double size, uint32_t seed)
+  {
+    int32_t i = static_cast<int32_t>(std::floor(s / size));
+    int32_t j = static_cast<int32_t>(std::floor(t / size));
+    uint32_t h = static_cast<uint32_t>(i) * 73856093u ^
+      static_cast<uint32_t>(j) * 19349663u ^ seed * 83492791u;
+    h ^= h >> 13;
+    h *= 0x5bd1e995u;
+    h ^= h >> 15;
+    return h & 0xff;
+  }
+
+  std::vector<Box> boxes_;
+};
+
+} // end of namespace
+
+#endif
@@ -4,63 +4,37 @@
 #include <iostream>
 
 #include "visualization.hpp"
+#include "image_conversion.hpp"
 
+using fovis_ros::visualization::Snapshot;
 
-void _drawPyramidLevelMatches(const fovis::VisualOdometry* odometry, int level, 
-    cv::Mat& canvas)
-{
-  using namespace fovis;
-
-  cv::Mat target_canvas(canvas.rowRange(0, canvas.rows/2));
-  cv::Mat reference_canvas(canvas.rowRange(canvas.rows/2, canvas.rows));
- 
-  const PyramidLevel* reference_level = odometry->getReferenceFrame()->getLevel(0);
-  for (int i = 0; i < reference_level->getNumKeypoints(); ++i)
-  {
-    const KeyPoint& kp = reference_level->getKeypoint(i);
-    cv::Point2f center(kp.u, kp.v);
-    cv::circle(reference_canvas, center, (level+1)*10, cv::Scalar(255, 0, 0));
-  }
-  const PyramidLevel* target_level = odometry->getTargetFrame()->getLevel(0);
-  for (int i = 0; i < target_level->getNumKeypoints(); ++i)
-  {
-    const KeyPoint& kp = target_level->getKeypoint(i);
-    cv::Point2f center(kp.u, kp.v);
-    cv::circle(target_canvas, center, (level+1)*10, cv::Scalar(255, 0, 0));
-  }
-}
 
-void _drawMatch(const fovis::FeatureMatch& match, cv::Mat& canvas)
+void _drawMatch(const Snapshot::Match& match, double scale, cv::Mat& canvas)
 {
-  using namespace fovis;
   cv::Mat target_canvas(canvas.rowRange(0, canvas.rows/2));
   cv::Mat reference_canvas(canvas.rowRange(canvas.rows/2, canvas.rows));
-  const KeyPoint& target_keypoint = match.target_keypoint->kp;
-  const KeyPoint& ref_keypoint = match.ref_keypoint->kp;
-  int target_level = match.target_keypoint->pyramid_level;
-  int ref_level = match.ref_keypoint->pyramid_level;
   cv::Point2f ref_center(
-      ref_keypoint.u*(ref_level+1), ref_keypoint.v*(ref_level+1));
+      match.ref_center.x*scale, match.ref_center.y*scale);
   cv::Point2f target_center(
-      target_keypoint.u*(target_level+1), target_keypoint.v*(target_level+1));
+      match.target_center.x*scale, match.target_center.y*scale);
   cv::Scalar color(0, 255, 0);
   if (!match.inlier)
     color = cv::Scalar(0, 0, 255);
   cv::circle(reference_canvas, ref_center, 
-      (match.ref_keypoint->pyramid_level+1)*10, color);
+      (match.ref_level+1)*10*scale, color);
   cv::circle(target_canvas, target_center, 
-      (match.target_keypoint->pyramid_level+1)*10, color);
+      (match.target_level+1)*10*scale, color);
   cv::Point2f global_ref_center(ref_center.x, ref_center.y + canvas.rows/2);
   cv::line(canvas, target_center, global_ref_center, color);
   // motion flow
   // cv::line(canvas, target_center, ref_center, color);
 }
 
-void _drawKeypoint(const fovis::KeypointData& kp_data, cv::Mat& canvas)
+void _drawKeypoint(const Snapshot::Keypoint& kp, double scale, cv::Mat& canvas)
 {
-  cv::Point2f center(kp_data.rect_base_uv.x(), kp_data.rect_base_uv.y());
+  cv::Point2f center(kp.center.x*scale, kp.center.y*scale);
   cv::Scalar color;
-  if (kp_data.has_depth)
+  if (kp.has_depth)
   {
     color = cv::Scalar(255, 0, 0);
   }
@@ -68,7 +42,7 @@ void _drawKeypoint(const fovis::KeypointData& kp_data, cv::Mat& canvas)
   {
     color = cv::Scalar(0, 0, 0);
   }
-  cv::circle(canvas, center, (kp_data.pyramid_level+1)*10, color);
+  cv::circle(canvas, center, (kp.level+1)*10*scale, color);
 }
 
 template<typename T>
@@ -79,65 +53,190 @@ std::string toStr(T t)
   return ss.str();
 }
 
-std::vector<std::string> _createInfoStrings(const fovis::VisualOdometry* odometry)
+void _createInfoStrings(const fovis::VisualOdometry* odometry,
+    std::vector<std::string>& infostrings)
 {
-  std::vector<std::string> infostrings;
+  infostrings.clear();
   infostrings.push_back(std::string("Status: ") + fovis::MotionEstimateStatusCodeStrings[odometry->getMotionEstimateStatus()]);
   infostrings.push_back(toStr(odometry->getTargetFrame()->getNumDetectedKeypoints()) + " keypoints");
   infostrings.push_back(toStr(odometry->getTargetFrame()->getNumKeypoints()) + " filtered keypoints");
   infostrings.push_back(toStr(odometry->getMotionEstimator()->getNumMatches()) + " matches");
   infostrings.push_back(toStr(odometry->getMotionEstimator()->getNumInliers()) + " inliers");
-  return infostrings;
 }
 
-cv::Mat fovis_ros::visualization::paint(const fovis::VisualOdometry* odometry)
+void _copyImage(const fovis::OdometryFrame* frame, cv::Mat& image)
+{
+  const fovis::PyramidLevel* level = frame->getLevel(0);
+  // We have to const cast here because there is no 
+  // cv::Mat constructor for const data.
+  // The data is copied right away.
+  const cv::Mat level_image(level->getHeight(), level->getWidth(), CV_8U,
+      const_cast<unsigned char*>(level->getGrayscaleImage()),
+      level->getGrayscaleImageStride());
+  level_image.copyTo(image);
+}
+
+void fovis_ros::visualization::takeSnapshot(
+    const fovis::VisualOdometry* odometry, Snapshot& snapshot,
+    bool copy_images)
 {
   using namespace fovis;
   const OdometryFrame* reference_frame = odometry->getReferenceFrame();
   const OdometryFrame* target_frame = odometry->getTargetFrame();
 
-  int width = target_frame->getLevel(0)->getWidth();
-  int height = target_frame->getLevel(0)->getHeight();
-
-  // We have to const cast here because there is no 
-  // cv::Mat constructor for const data.
-  // The data will be copied later anyways.
-  const cv::Mat reference_image(height, width, CV_8U, 
-      const_cast<unsigned char*>(
-        reference_frame->getLevel(0)->getGrayscaleImage()));
-  const cv::Mat target_image(height, width, CV_8U,
-      const_cast<unsigned char*>(
-        target_frame->getLevel(0)->getGrayscaleImage()),
-      target_frame->getLevel(0)->getGrayscaleImageStride());
-
-  cv::Mat canvas(2*height, width, CV_8U);
-  cv::Mat upper_canvas(canvas.rowRange(0, height));
-  cv::Mat lower_canvas(canvas.rowRange(height, 2*height));
-  target_image.copyTo(upper_canvas);
-  reference_image.copyTo(lower_canvas);
-  cv::cvtColor(canvas, canvas, CV_GRAY2BGR);
+  snapshot.width = target_frame->getLevel(0)->getWidth();
+  snapshot.height = target_frame->getLevel(0)->getHeight();
+  if (copy_images)
+  {
+    _copyImage(reference_frame, snapshot.reference_image);
+    _copyImage(target_frame, snapshot.target_image);
+  }
 
+  snapshot.keypoints.clear();
   for (int level = 0; level < reference_frame->getNumLevels(); ++level)
   {
     const PyramidLevel* pyramid_level = reference_frame->getLevel(level);
     for (int i = 0; i < pyramid_level->getNumKeypoints(); ++i)
     {
-      _drawKeypoint(*(pyramid_level->getKeypointData(i)), canvas);
+      const KeypointData* kp_data = pyramid_level->getKeypointData(i);
+      Snapshot::Keypoint kp;
+      kp.center = cv::Point2f(
+          kp_data->rect_base_uv.x(), kp_data->rect_base_uv.y());
+      kp.level = kp_data->pyramid_level;
+      kp.has_depth = kp_data->has_depth;
+      snapshot.keypoints.push_back(kp);
     }
   }
-      
+
   const MotionEstimator* motion_estimator = odometry->getMotionEstimator(); 
+  snapshot.matches.clear();
   for (int i = 0; i < motion_estimator->getNumMatches(); ++i)
   {
-    _drawMatch(motion_estimator->getMatches()[i], canvas);
+    const FeatureMatch& feature_match = motion_estimator->getMatches()[i];
+    const KeypointData* target_keypoint = feature_match.target_keypoint;
+    const KeypointData* ref_keypoint = feature_match.ref_keypoint;
+    Snapshot::Match match;
+    match.ref_level = ref_keypoint->pyramid_level;
+    match.target_level = target_keypoint->pyramid_level;
+    // base level positions, like the keypoints above
+    match.ref_center = cv::Point2f(
+        ref_keypoint->rect_base_uv.x(), ref_keypoint->rect_base_uv.y());
+    match.target_center = cv::Point2f(
+        target_keypoint->rect_base_uv.x(), target_keypoint->rect_base_uv.y());
+    match.inlier = feature_match.inlier;
+    snapshot.matches.push_back(match);
   }
-  std::vector<std::string> infostrings = _createInfoStrings(odometry);
-  for (size_t i = 0; i < infostrings.size(); ++i)
+
+  _createInfoStrings(odometry, snapshot.infostrings);
+}
+
+void fovis_ros::visualization::toMsg(const Snapshot& snapshot,
+    FovisFeatures& msg)
+{
+  msg.width = snapshot.width;
+  msg.height = snapshot.height;
+  msg.keypoints.resize(snapshot.keypoints.size());
+  for (size_t i = 0; i < snapshot.keypoints.size(); ++i)
   {
-    cv::putText(canvas, infostrings[i], cv::Point(10, 40*(i + 1)),
-          CV_FONT_HERSHEY_SIMPLEX, 1.0, cv::Scalar(0, 255, 255), 3);
+    const Snapshot::Keypoint& kp = snapshot.keypoints[i];
+    FovisKeypoint& kp_msg = msg.keypoints[i];
+    kp_msg.u = kp.center.x;
+    kp_msg.v = kp.center.y;
+    kp_msg.level = kp.level;
+    kp_msg.has_depth = kp.has_depth;
   }
-  return canvas;
+  msg.matches.resize(snapshot.matches.size());
+  for (size_t i = 0; i < snapshot.matches.size(); ++i)
+  {
+    const Snapshot::Match& match = snapshot.matches[i];
+    FovisMatch& match_msg = msg.matches[i];
+    match_msg.ref_u = match.ref_center.x;
+    match_msg.ref_v = match.ref_center.y;
+    match_msg.target_u = match.target_center.x;
+    match_msg.target_v = match.target_center.y;
+    match_msg.ref_level = match.ref_level;
+    match_msg.target_level = match.target_level;
+    match_msg.inlier = match.inlier;
+  }
+  msg.info_strings = snapshot.infostrings;
+}
+
+void fovis_ros::visualization::fromMsg(const FovisFeatures& msg,
+    Snapshot& snapshot)
+{
+  snapshot.width = msg.width;
+  snapshot.height = msg.height;
+  snapshot.reference_image.create(msg.height, msg.width, CV_8U);
+  snapshot.reference_image.setTo(cv::Scalar(255));
+  snapshot.reference_image.copyTo(snapshot.target_image);
+  snapshot.keypoints.resize(msg.keypoints.size());
+  for (size_t i = 0; i < msg.keypoints.size(); ++i)
+  {
+    const FovisKeypoint& kp_msg = msg.keypoints[i];
+    Snapshot::Keypoint& kp = snapshot.keypoints[i];
+    kp.center = cv::Point2f(kp_msg.u, kp_msg.v);
+    kp.level = kp_msg.level;
+    kp.has_depth = kp_msg.has_depth;
+  }
+  snapshot.matches.resize(msg.matches.size());
+  for (size_t i = 0; i < msg.matches.size(); ++i)
+  {
+    const FovisMatch& match_msg = msg.matches[i];
+    Snapshot::Match& match = snapshot.matches[i];
+    match.ref_center = cv::Point2f(match_msg.ref_u, match_msg.ref_v);
+    match.target_center = cv::Point2f(match_msg.target_u, match_msg.target_v);
+    match.ref_level = match_msg.ref_level;
+    match.target_level = match_msg.target_level;
+    match.inlier = match_msg.inlier;
+  }
+  snapshot.infostrings = msg.info_strings;
 }
 
+cv::Mat fovis_ros::visualization::paint(const Snapshot& snapshot, double scale)
+{
+  int width = snapshot.target_image.cols * scale;
+  int height = snapshot.target_image.rows * scale;
+
+  cv::Mat gray_canvas(2*height, width, CV_8U);
+  cv::Mat upper_canvas(gray_canvas.rowRange(0, height));
+  cv::Mat lower_canvas(gray_canvas.rowRange(height, 2*height));
+  if (scale == 1.0)
+  {
+    snapshot.target_image.copyTo(upper_canvas);
+    snapshot.reference_image.copyTo(lower_canvas);
+  }
+  else
+  {
+    cv::resize(snapshot.target_image, upper_canvas, upper_canvas.size(),
+        0, 0, cv::INTER_AREA);
+    cv::resize(snapshot.reference_image, lower_canvas, lower_canvas.size(),
+        0, 0, cv::INTER_AREA);
+  }
+  cv::Mat canvas(2*height, width, CV_8UC3);
+  fovis_ros::image_conversion::grayToBgr(gray_canvas.data, gray_canvas.step[0],
+      width, 2*height, canvas.data, canvas.step[0]);
+
+  for (size_t i = 0; i < snapshot.keypoints.size(); ++i)
+  {
+    _drawKeypoint(snapshot.keypoints[i], scale, canvas);
+  }
+  for (size_t i = 0; i < snapshot.matches.size(); ++i)
+  {
+    _drawMatch(snapshot.matches[i], scale, canvas);
+  }
+  for (size_t i = 0; i < snapshot.infostrings.size(); ++i)
+  {
+    cv::putText(canvas, snapshot.infostrings[i],
+          cv::Point(10*scale, 40*(i + 1)*scale),
+          CV_FONT_HERSHEY_SIMPLEX, 1.0*scale, cv::Scalar(0, 255, 255),
+          std::max(1, static_cast<int>(3*scale)));
+  }
+  return canvas;
+}
 
+cv::Mat fovis_ros::visualization::paint(const fovis::VisualOdometry* odometry)
+{
+  Snapshot snapshot;
+  takeSnapshot(odometry, snapshot);
+  return paint(snapshot);
+}
@@ -1,10 +1,12 @@
 #ifndef __FOVIS_ROS_VISUALIZATION_H__
 #define __FOVIS_ROS_VISUALIZATION_H__
 
-namespace cv
-{
-  class Mat;
-}
+#include <string>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+#include <fovis_ros/FovisFeatures.h>
 
 namespace fovis
 {
@@ -16,6 +18,66 @@ namespace fovis_ros
 
 namespace visualization
 {
+  /**
+   * Everything paint() needs from the odometer, copied so that the
+   * image can be rendered while the odometer processes the next frame.
+   */
+  struct Snapshot
+  {
+    struct Keypoint
+    {
+      cv::Point2f center;
+      int level;
+      bool has_depth;
+    };
+
+    struct Match
+    {
+      cv::Point2f ref_center;
+      cv::Point2f target_center;
+      int ref_level;
+      int target_level;
+      bool inlier;
+    };
+
+    // size of the base level images
+    int width;
+    int height;
+    cv::Mat reference_image;
+    cv::Mat target_image;
+    std::vector<Keypoint> keypoints;
+    std::vector<Match> matches;
+    std::vector<std::string> infostrings;
+  };
+
+  /**
+   * Copies the data needed for painting from odometry into snapshot,
+   * reusing the memory of snapshot.
+   * \param copy_images if false, the images of snapshot are left
+   *        untouched and only keypoints, matches and info strings are
+   *        copied
+   */
+  void takeSnapshot(const fovis::VisualOdometry* odometry, Snapshot& snapshot,
+      bool copy_images = true);
+
+  /**
+   * Converts keypoints, matches and info strings of snapshot to msg,
+   * reusing the memory of msg. The header is not touched.
+   */
+  void toMsg(const Snapshot& snapshot, FovisFeatures& msg);
+
+  /**
+   * Converts msg to snapshot. As the message carries no images, both
+   * images are set to a blank image of the original size.
+   */
+  void fromMsg(const FovisFeatures& msg, Snapshot& snapshot);
+
+  /**
+   * Renders target and reference image of snapshot with keypoints and
+   * matches, scaled by scale.
+   */
+  cv::Mat paint(const Snapshot& snapshot, double scale = 1.0);
+
   cv::Mat paint(const fovis::VisualOdometry* odometry);
 } // end of namespace visualization
 
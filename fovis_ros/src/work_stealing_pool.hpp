@@ -0,0 +1,173 @@
+#ifndef WORK_STEALING_POOL_H_
+#define WORK_STEALING_POOL_H_
+
+#include <deque>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/tss.hpp>
+
+namespace fovis_ros
+{
+
+/**
+ * Fixed size thread pool with one task deque per worker. Workers take
+ * their own tasks newest first and steal the oldest tasks of other
+ * workers when they run out of work. Tasks submitted from a worker go
+ * to its own deque, others are distributed round robin. There is no
+ * ordering between tasks, callers that need ordering have to make sure
+ * that only one of their tasks exists at a time.
+ */
+class WorkStealingPool
+{
+
+public:
+
+  typedef boost::function<void()> Task;
+
+  /**
+   * \param num_threads number of worker threads, at least one
+   */
+  explicit WorkStealingPool(int num_threads) :
+    num_pending_(0),
+    sleepers_(0),
+    next_queue_(0),
+    stop_(false)
+  {
+    if (num_threads < 1) num_threads = 1;
+    for (int i = 0; i < num_threads; ++i)
+    {
+      queues_.push_back(boost::shared_ptr<Queue>(new Queue));
+    }
+    for (int i = 0; i < num_threads; ++i)
+    {
+      threads_.create_thread(boost::bind(&WorkStealingPool::workLoop, this, i));
+    }
+  }
+
+  /**
+   * Runs all tasks that are still queued and joins the workers.
+   */
+  ~WorkStealingPool()
+  {
+    {
+      boost::lock_guard<boost::mutex> lock(mutex_);
+      stop_ = true;
+      condition_.notify_all();
+    }
+    threads_.join_all();
+  }
+
+  void submit(const Task& task)
+  {
+    size_t index;
+    if (worker_index_.get())
+    {
+      index = *worker_index_;
+    }
+    else
+    {
+      index = __sync_fetch_and_add(&next_queue_, 1) % queues_.size();
+    }
+    {
+      boost::lock_guard<boost::mutex> lock(queues_[index]->mutex);
+      queues_[index]->tasks.push_back(task);
+    }
+    __sync_fetch_and_add(&num_pending_, 1);
+    // pairs with the increment of sleepers_ in workLoop(), see
+    // SpscQueue::wakeUp()
+    __sync_synchronize();
+    if (sleepers_ > 0)
+    {
+      boost::lock_guard<boost::mutex> lock(mutex_);
+      condition_.notify_one();
+    }
+  }
+
+  int size() const
+  {
+    return queues_.size();
+  }
+
+private:
+
+  struct Queue
+  {
+    boost::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  /**
+   * Takes the newest task of queue index or steals the oldest task of
+   * another queue.
+   */
+  bool take(size_t index, Task& task)
+  {
+    {
+      Queue& own = *queues_[index];
+      boost::lock_guard<boost::mutex> lock(own.mutex);
+      if (!own.tasks.empty())
+      {
+        task.swap(own.tasks.back());
+        own.tasks.pop_back();
+        return true;
+      }
+    }
+    for (size_t i = 1; i < queues_.size(); ++i)
+    {
+      Queue& victim = *queues_[(index + i) % queues_.size()];
+      boost::lock_guard<boost::mutex> lock(victim.mutex);
+      if (!victim.tasks.empty())
+      {
+        task.swap(victim.tasks.front());
+        victim.tasks.pop_front();
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void workLoop(int index)
+  {
+    worker_index_.reset(new size_t(index));
+    Task task;
+    while (true)
+    {
+      if (take(index, task))
+      {
+        __sync_fetch_and_sub(&num_pending_, 1);
+        task();
+        task.clear();
+        continue;
+      }
+      boost::unique_lock<boost::mutex> lock(mutex_);
+      __sync_fetch_and_add(&sleepers_, 1);
+      while (!stop_ && num_pending_ == 0)
+        condition_.wait(lock);
+      __sync_fetch_and_sub(&sleepers_, 1);
+      if (stop_ && num_pending_ == 0) return;
+    }
+  }
+
+  std::vector<boost::shared_ptr<Queue> > queues_;
+  boost::thread_group threads_;
+  boost::thread_specific_ptr<size_t> worker_index_;
+
+  // number of tasks in all queues
+  volatile int num_pending_;
+  volatile int sleepers_;
+  volatile size_t next_queue_;
+  bool stop_;
+  boost::mutex mutex_;
+  boost::condition_variable condition_;
+};
+
+} // end of namespace
+
+#endif